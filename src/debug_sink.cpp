@@ -0,0 +1,161 @@
+/**
+ * @file debug_sink.cpp
+ * @brief Feedback images written to files instead of displayed.
+ *
+ * Stages call add() with a name and a renderer. If the name is enabled, the renderer is queued and run on a
+ * background thread, which writes the image to <output dir>/<input file stem>/<name>.png.
+ * Otherwise nothing is rendered at all, so a normal run pays only for the name lookup.
+ *
+ * Renderers run after the stage has moved on, so they must capture the Mats they draw from by value,
+ * and the stage must not overwrite those Mats in place afterwards.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgcodecs.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#endif
+
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+using namespace cv ;
+
+#include "debug_sink.hpp"
+
+DebugSink::DebugSink() : is_all_enabled(false), is_busy(false), is_stopping(false) {}
+
+DebugSink::~DebugSink() {
+	if(worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mtx) ;
+			is_stopping = true ;
+		}
+		cv_jobs.notify_all() ;
+		worker.join() ;
+	}
+}
+
+/**
+ * @brief Set the directory under which a subdirectory is created for each input file
+ */
+void DebugSink::set_output_dir(const std::string &dir) {
+	output_dir = dir ;
+}
+
+/**
+ * @brief Enable image names
+ *
+ * @param names comma-separated, or "all"
+ */
+void DebugSink::enable(const std::string &names) {
+	std::stringstream ss(names) ;
+	std::string name ;
+
+	while(std::getline(ss, name, ',')) {
+		if(name == "all") {
+			is_all_enabled = true ;
+		} else if(!name.empty()) {
+			enabled_names.insert(name) ;
+		}
+	}
+}
+
+bool DebugSink::is_active() const {
+	return !output_dir.empty() && (is_all_enabled || !enabled_names.empty()) ;
+}
+
+bool DebugSink::is_enabled(const std::string &name) const {
+	return is_active() && (is_all_enabled || enabled_names.count(name) > 0) ;
+}
+
+/**
+ * @brief Start a new input file. Images added after this go to a directory named after its stem.
+ */
+void DebugSink::begin_input(const std::string &input_path) {
+	if(!is_active()) {
+		return ;
+	}
+
+	auto base = input_path.substr(input_path.find_last_of('/') + 1) ;
+	auto stem = base.substr(0, base.find_last_of('.')) ;
+
+	mkdir(output_dir.c_str(), 0755) ;
+	input_dir = output_dir + "/" + stem ;
+	mkdir(input_dir.c_str(), 0755) ;
+}
+
+/**
+ * @brief Offer a debug image. It is only rendered if name is enabled, and then on the background thread.
+ *
+ * @param name image name, also the file name without extension
+ * @param render returns the image to write, or an empty Mat to write nothing
+ */
+void DebugSink::add(const std::string &name, renderer render) {
+	if(!is_enabled(name) || input_dir.empty()) {
+		return ;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mtx) ;
+		jobs.push_back({ input_dir + "/" + name + ".png", render }) ;
+
+		if(!worker.joinable()) {
+			worker = std::thread(&DebugSink::run, this) ;
+		}
+	}
+	cv_jobs.notify_one() ;
+}
+
+/**
+ * @brief Wait until all queued images are written
+ */
+void DebugSink::flush() {
+	std::unique_lock<std::mutex> lock(mtx) ;
+	cv_idle.wait(lock, [this] { return jobs.empty() && !is_busy ; }) ;
+}
+
+void DebugSink::run() {
+	std::unique_lock<std::mutex> lock(mtx) ;
+
+	while(true) {
+		cv_jobs.wait(lock, [this] { return is_stopping || !jobs.empty() ; }) ;
+
+		if(jobs.empty()) {
+			//stopping, and nothing left to write
+			break ;
+		}
+
+		job jb = jobs.front() ;
+		jobs.pop_front() ;
+		is_busy = true ;
+		lock.unlock() ;
+
+		Mat img = jb.render() ;
+		if(!img.empty() && !imwrite(jb.path, img)) {
+			std::cerr << "Could not write debug image " << jb.path << std::endl ;
+		}
+
+		lock.lock() ;
+		is_busy = false ;
+		if(jobs.empty()) {
+			cv_idle.notify_all() ;
+		}
+	}
+}
+
+/**
+ * @brief The sink shared by all stages of a program
+ */
+DebugSink &debug_sink() {
+	static DebugSink sink ;
+	return sink ;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file debug_sink.hpp
+ * @brief Feedback images written to files instead of displayed, for investigating failures on machines without a display.
+ * Each stage offers its image as a renderer, which is only run when that image name is enabled.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+class DebugSink {
+public:
+	typedef std::function<cv::Mat()> renderer ;
+
+	DebugSink() ;
+	~DebugSink() ;
+
+	void set_output_dir(const std::string &dir) ;
+	void enable(const std::string &names) ;
+	bool is_active() const ;
+	bool is_enabled(const std::string &name) const ;
+
+	void begin_input(const std::string &input_path) ;
+	void add(const std::string &name, renderer render) ;
+	void flush() ;
+
+private:
+	struct job {
+		std::string path ;
+		renderer render ;
+	} ;
+
+	void run() ;
+
+	std::string output_dir ;
+	std::string input_dir ;	//subdirectory for the current input file
+	std::set<std::string> enabled_names ;
+	bool is_all_enabled ;
+
+	std::deque<job> jobs ;
+	bool is_busy ;
+	bool is_stopping ;
+	std::mutex mtx ;
+	std::condition_variable cv_jobs ;
+	std::condition_variable cv_idle ;
+	std::thread worker ;
+} ;
+
+DebugSink &debug_sink() ;
@@ -29,6 +29,10 @@ Detects and extract images for drinks from an image of a Japanese soft-drink ven
 #include "run_length.hpp"
 #include "trim_rect.hpp"
 #include "threshold.hpp"
+#include "warp_roi.hpp"
+#include "mat_pool.hpp"
+#include "debug_sink.hpp"
+#include "jpeg_roi.hpp"
 
 #include "extract_drinks_write.hpp"
 
@@ -55,6 +59,11 @@ std::string slot_image_filename(const std::string &basename, int row, int slot_n
 // std::vector<Rect> build_row_rects(std::vector<int> sep_lines, int height, Point pt_strip_tl) ;
 void build_row_rects(const std::vector<int> sep_lines, int height, Point pt_strip_tl, std::vector<Rect> &rects_drinks, std::vector<Rect> &rects_prices) ;
 void write_slot_image_files(Mat img, std::vector<std::vector<Rect> > slot_row_rects, std::string outfilepath, std::string prefix) ;
+std::string sidecar_path_for(const std::string &sidecar_dir, const std::string &infilepath) ;
+Mat corrected_detection_image(const Mat &src_original, const perspective_sidecar &sidecar, float scale) ;
+std::vector<std::vector<Rect> > scale_rect_rows(const std::vector<std::vector<Rect> > &rect_rows, float scale, Size bounds) ;
+void warp_rect_rows(const Mat &src_original, const perspective_sidecar &sidecar, 
+    const std::vector<std::vector<Rect> > &rect_rows, std::vector<std::vector<Mat> > &image_rows) ;
 // std::vector<int> detect_drink_rows(Mat src, std::vector<Vec4i> horizontal_lines) ;
 // std::vector<size_t> get_drink_columns(Mat img) ;
 // void plot_hough_and_bounds(Mat src_bgr, std::vector<Vec4i> hough_lines, std::vector<Vec4i> bounds_tblr) ;
@@ -96,9 +105,17 @@ void help() {
     std::cout << "  -b : batch mode (no display)" << std::endl ;
     std::cout << "  -c : print drink slot configuration for first file (no drink image files written)" << std::endl ;
     std::cout << "  -d [path] : batch mode target directory" << std::endl ;
+    std::cout << "  -D [dir] : write debug images to a subdirectory of dir for each input (default: <target>/debug)" << std::endl ;
+    std::cout << "  -e [names] : debug images to write, comma-separated, or all (default with -D: all)" << std::endl ;
+    std::cout << "             threshold, slots" << std::endl ;
     std::cout << "  -f : do not write output files" << std::endl ;
     std::cout << "  -h : help" << std::endl ;
+    std::cout << "  -L : cut slot images from the input JPEG losslessly, without re-encoding. Slot origins move up and left" << std::endl ;
+    std::cout << "       to the 8 or 16 pixel JPEG block grid. Ignored with -H, or if the input is not an upright JPEG" << std::endl ;
+    std::cout << "  -H [dir] : inputs are original photos, corrected with the fixperspective --homography-only sidecars in dir." << std::endl ;
+    std::cout << "             Slot images are warped directly from the original." << std::endl ;
     std::cout << "  -p : disable perspective correction" << std::endl ;
+    std::cout << "  -S [scale] : with -H, scale of the corrected image used for detection (default 1.0)" << std::endl ;
     std::cout << "  -t : disable trimming slots to container" << std::endl ;
     std::cout << "  -T [num]: highlight detection threshold" << std::endl ;
     std::cout << "  -v : verbose" << std::endl ;
@@ -124,7 +141,12 @@ bool cmdopt_configuration = false ;
 bool cmdopt_perspective = true ;
 bool cmdopt_trim_to_container = true ;
 bool cmdopt_write_files = true ;
+bool cmdopt_lossless_slots = false ;
 int cmdoptval_threshold = 0 ;
+std::string cmdoptval_sidecar_dir ;
+float cmdoptval_detection_scale = 1.0 ;
+std::string cmdoptval_debug_dir ;
+std::string cmdoptval_debug_images ;
 
 int handle_args(int argc, char **argv) {
  int c;
@@ -226,8 +248,11 @@ int main(int argc, char **argv) {
     }
 
     dest_dir = default_dest_dir ;
+
+    //reuse the buffers of the temporary images from one photo to the next
+    install_mat_pool() ;
     
-    while((c = getopt(argc, argv, "bcd:fhptT:v")) != -1) {
+    while((c = getopt(argc, argv, "bcd:D:e:fhH:LpS:tT:v")) != -1) {
         switch(c) {
         case 'b':
             cmdopt_batch = true ;
@@ -239,6 +264,12 @@ int main(int argc, char **argv) {
             cvalue = optarg ;
             dest_dir = cvalue ;
             break ;
+        case 'D':
+            cmdoptval_debug_dir = optarg ;
+            break ;
+        case 'e':
+            cmdoptval_debug_images = optarg ;
+            break ;
         case 'f':
             cvalue = optarg ;
             cmdopt_write_files = false ;
@@ -246,9 +277,22 @@ int main(int argc, char **argv) {
         case 'h':
             help() ;
             exit(0) ;
+        case 'H':
+            cmdoptval_sidecar_dir = optarg ;
+            break ;
+        case 'L':
+            cmdopt_lossless_slots = true ;
+            break ;
         case 'p':
             cmdopt_perspective = false ;
             break ;
+        case 'S':
+            cmdoptval_detection_scale = atof(optarg) ;
+            if(cmdoptval_detection_scale <= 0 || cmdoptval_detection_scale > 1) {
+                std::cerr << "Detection scale must be in (0, 1]" << std::endl ;
+                exit(-1) ;
+            }
+            break ;
         case 't':
             cmdopt_trim_to_container = false ;
             break ;
@@ -269,6 +313,11 @@ int main(int argc, char **argv) {
     }
     #endif
 
+    if(!cmdoptval_debug_dir.empty() || !cmdoptval_debug_images.empty()) {
+        debug_sink().set_output_dir(cmdoptval_debug_dir.empty() ? dest_dir + "/debug" : cmdoptval_debug_dir) ;
+        debug_sink().enable(cmdoptval_debug_images.empty() ? "all" : cmdoptval_debug_images) ;
+    }
+
     int result = 0 ;
     
     for (int idx = optind ; idx < argc ; idx++) {
@@ -284,6 +333,7 @@ int main(int argc, char **argv) {
             std::cout << "Start processing " << filename << std::endl ;
         }
         
+        debug_sink().begin_input(filename) ;
         result = process_file(filename, dest_dir) ;
         
         if(cmdopt_verbose) {
@@ -298,6 +348,12 @@ int main(int argc, char **argv) {
         }
         #endif
     }
+
+    debug_sink().flush() ;
+
+    if(cmdopt_verbose) {
+        mat_pool()->print_stats(std::cout) ;
+    }
     
     return result ;
 }
@@ -312,6 +368,20 @@ int process_file(std::string infilepath, const std::string dest_dir) {
         std::cerr << "File is not a valid image: " << infilepath << std::endl ;
         return -1 ;
     }
+
+    //With a sidecar, the input is the original photo. Detection runs on a corrected copy,
+    //possibly reduced, and the slot images are warped from the original at the end.
+    Mat src_original ;
+    perspective_sidecar sidecar ;
+    const bool is_sidecar = !cmdoptval_sidecar_dir.empty() ;
+
+    if(is_sidecar) {
+        if(!read_perspective_sidecar(sidecar_path_for(cmdoptval_sidecar_dir, infilepath), sidecar)) {
+            return -1 ;
+        }
+        src_original = src ;
+        src = corrected_detection_image(src_original, sidecar, cmdoptval_detection_scale) ;
+    }
         
     Mat src_gray ;
     cvtColor(src, src_gray, COLOR_BGR2GRAY) ;
@@ -373,6 +443,23 @@ int process_file(std::string infilepath, const std::string dest_dir) {
     if(cmdopt_verbose) {
         std::cout << "Created " << strips.size() << " ButtonStrip objects from " << button_strip_contours.size() << " contours." << std::endl ;
     }
+
+    if(debug_sink().is_enabled("threshold")) {
+        std::vector<Rect> strip_rects ;
+        for(const auto &strip : strips) {
+            strip_rects.push_back(strip->rc()) ;
+        }
+
+        debug_sink().add("threshold", [src_gray, strip_detection_thresh, strip_rects]() {
+            Mat img_debug ;
+            threshold(src_gray, img_debug, strip_detection_thresh, 255, THRESH_BINARY) ;
+            cvtColor(img_debug, img_debug, COLOR_GRAY2BGR) ;
+            for(const auto &rc : strip_rects) {
+                rectangle(img_debug, rc, Scalar(0, 0, 255), 4) ;
+            }
+            return img_debug ;
+        }) ;
+    }
     //////////////////
 
 
@@ -381,15 +468,19 @@ int process_file(std::string infilepath, const std::string dest_dir) {
 
 
     #ifdef USE_GUI
+    //the threshold image is only for feedback
     Mat img_thresh ;
-    threshold(src_gray, img_thresh, strip_detection_thresh, 255, THRESH_BINARY) ;
-    cvtColor(img_thresh, img_thresh, COLOR_GRAY2BGR) ;
- 
     std::stringstream strtitle ;
-    strtitle << "Threshold image: " << strip_detection_thresh ;
 
-    for(const auto &strip : strips) {
-        draw_strip_boundary(img_thresh, strip) ;
+    if(!cmdopt_batch) {
+        threshold(src_gray, img_thresh, strip_detection_thresh, 255, THRESH_BINARY) ;
+        cvtColor(img_thresh, img_thresh, COLOR_GRAY2BGR) ;
+     
+        strtitle << "Threshold image: " << strip_detection_thresh ;
+
+        for(const auto &strip : strips) {
+            draw_strip_boundary(img_thresh, strip) ;
+        }
     }
     #endif
 
@@ -457,10 +548,10 @@ int process_file(std::string infilepath, const std::string dest_dir) {
     
     //draw the trimmed rects
     #ifdef USE_GUI
-    for(auto rc : trimmed_rects) {
-        rectangle(img_thresh, rc, Scalar(220, 250, 92), 4) ;
-    }
     if(!cmdopt_batch) {
+        for(auto rc : trimmed_rects) {
+            rectangle(img_thresh, rc, Scalar(220, 250, 92), 4) ;
+        }
         imshow(strtitle.str(), scale_for_display(img_thresh)) ;
     }
     #endif
@@ -516,14 +607,18 @@ int process_file(std::string infilepath, const std::string dest_dir) {
 
     /* New scheme: Instead of analyzing the periodicity of individual strips, merge them 
     */
-   std::vector<Mat> thresh_images ;
-   for(auto strip : strips) {
-       thresh_images.push_back(strip->img_thresh()) ;
-   }
+    #ifdef USE_GUI
+    if(!cmdopt_batch) {
+        std::vector<Mat> thresh_images ;
+        for(auto strip : strips) {
+            thresh_images.push_back(strip->img_thresh()) ;
+        }
 
-    Mat img_merged_thresh = merge_thresh_images(thresh_images) ;
-    resize(img_merged_thresh, img_merged_thresh, Size(1000, img_merged_thresh.rows * 8)) ;
-    // imshow("Merged thresh", img_merged_thresh) ;
+        Mat img_merged_thresh = merge_thresh_images(thresh_images) ;
+        resize(img_merged_thresh, img_merged_thresh, Size(1000, img_merged_thresh.rows * 8)) ;
+        // imshow("Merged thresh", img_merged_thresh) ;
+    }
+    #endif
 
     const auto RLSD_THRESHOLD = 10.0 ;//5.0
     std::vector<std::shared_ptr<ButtonStrip> > strips_with_good_rlsd ;
@@ -680,55 +775,93 @@ int process_file(std::string infilepath, const std::string dest_dir) {
         drink_rect_rows.push_back(rects_drinks) ;
         price_rect_rows.push_back(rects_prices) ;
     }
+
+    debug_sink().add("slots", [src, drink_rect_rows, price_rect_rows]() {
+        Mat img_debug = src.clone() ;
+        for(const auto &row : drink_rect_rows) {
+            for(const auto &rc : row) {
+                rectangle(img_debug, rc, Scalar(0, 255, 0), 3) ;
+            }
+        }
+        for(const auto &row : price_rect_rows) {
+            for(const auto &rc : row) {
+                rectangle(img_debug, rc, Scalar(255, 0, 0), 3) ;
+            }
+        }
+        return img_debug ;
+    }) ;
     
     //now use the price tags to measure the spacing(
+    //So far the thresholded price tag strips are only for feedback
+    #ifdef USE_GUI
     std::vector<Mat> price_strip_images ;
 
-    for(const auto rc : pricetag_strips) {
-        Mat strip_image = src(rc) ;
-        cvtColor(strip_image, strip_image, COLOR_BGR2GRAY) ;
-        Mat intensity_image, thresh_image ;
-        reduce(strip_image, intensity_image, 0, REDUCE_AVG) ; 
-	    blur(intensity_image, intensity_image, Size(3, 3)) ;
+    if(!cmdopt_batch) {
+        for(const auto rc : pricetag_strips) {
+            Mat strip_image = src(rc) ;
+            cvtColor(strip_image, strip_image, COLOR_BGR2GRAY) ;
+            Mat intensity_image, thresh_image ;
+            reduce(strip_image, intensity_image, 0, REDUCE_AVG) ; 
+            blur(intensity_image, intensity_image, Size(3, 3)) ;
+
+            std::vector<int> levels = intensity_image.row(0) ;
+
+            auto result = std::minmax_element(levels.begin(), levels.end()) ;
+            int min_idx = result.first - levels.begin() ;
+            int max_idx = result.second - levels.begin() ;
+            int max_level = levels[max_idx] ;
+            int min_level = levels[min_idx] ;
+
+            int slot_separator_threshold = (max_level + min_level) / 2  ;
+            if(cmdopt_verbose) {
+                // std::cout << "Max:" << max_level << " Min:" << min_level << " Threshold: " << slot_separator_threshold << std::endl ;
+            }
 
-        std::vector<int> levels = intensity_image.row(0) ;
+            threshold(intensity_image, thresh_image, slot_separator_threshold, 255, THRESH_BINARY) ;
+            resize(thresh_image, thresh_image, Size(), 1, 32) ;
+            price_strip_images.push_back(thresh_image) ;
+        }
+    }
+    #endif
 
-        auto result = std::minmax_element(levels.begin(), levels.end()) ;
-        int min_idx = result.first - levels.begin() ;
-        int max_idx = result.second - levels.begin() ;
-        int max_level = levels[max_idx] ;
-        int min_level = levels[min_idx] ;
 
-        int slot_separator_threshold = (max_level + min_level) / 2  ;
-        if(cmdopt_verbose) {
-            // std::cout << "Max:" << max_level << " Min:" << min_level << " Threshold: " << slot_separator_threshold << std::endl ;
-        }
+    //slot images warped from the original, and their rects at full scale
+    std::vector<std::vector<Rect> > full_drink_rect_rows, full_price_rect_rows ;
+    std::vector<std::vector<Mat> > drink_image_rows, price_image_rows ;
 
-        threshold(intensity_image, thresh_image, slot_separator_threshold, 255, THRESH_BINARY) ;
-        resize(thresh_image, thresh_image, Size(), 1, 32) ;
-        price_strip_images.push_back(thresh_image) ;
-    }
+    if(is_sidecar) {
+        const Size output_size = sidecar.output_rect().size() ;
 
+        full_drink_rect_rows = scale_rect_rows(drink_rect_rows, cmdoptval_detection_scale, output_size) ;
+        full_price_rect_rows = scale_rect_rows(price_rect_rows, cmdoptval_detection_scale, output_size) ;
 
-    if(cmdopt_trim_to_container) {
-        std::vector<std::vector<Rect> > trimmed_drink_rect_rows ;
+        warp_rect_rows(src_original, sidecar, full_drink_rect_rows, drink_image_rows) ;
+        if(cmdopt_write_files) {
+            warp_rect_rows(src_original, sidecar, full_price_rect_rows, price_image_rows) ;
+        }
+
+        //trim on the full resolution slot images, as is done on the corrected image below
+        for(size_t r = 0 ; cmdopt_trim_to_container && r < drink_image_rows.size() ; r++) {
+            for(size_t i = 0 ; i < drink_image_rows[r].size() ; i++) {
+                Mat &img_slot = drink_image_rows[r][i] ;
+                if(img_slot.empty()) {
+                    continue ;
+                }
 
-        //Trim the slot rectangles to the container based on the background and side edges
-        //detected in the image
-        for(const auto &rect_row : drink_rect_rows) {
-            std::vector <Rect> rects_row ;
-            for(auto rc : rect_row) {
-                Mat img_slot = src_gray(rc) ;
-                Mat detected_corners ;
-                Rect rc_trimmed = get_trim_rect(img_slot, detected_corners) ;
+                Mat img_slot_gray ;
+                cvtColor(img_slot, img_slot_gray, COLOR_BGR2GRAY) ;
+                Rect rc_trimmed = get_trim_rect_fast(img_slot_gray) ;
 
-                Rect rc_trimmed_on_full_image = 
-                    rc_trimmed + rc.tl() ;
-                rects_row.push_back(rc_trimmed_on_full_image) ;
+                full_drink_rect_rows[r][i] = rc_trimmed + full_drink_rect_rows[r][i].tl() ;
+                img_slot = img_slot(rc_trimmed) ;
             }
-            trimmed_drink_rect_rows.push_back(rects_row) ;
-        }            
-        drink_rect_rows = trimmed_drink_rect_rows ;
+        }
+    }
+
+    if(cmdopt_trim_to_container && !is_sidecar) {
+        //Trim the slot rectangles to the container based on the background detected in the image,
+        //a whole row of slots at a time, with the rows in parallel
+        drink_rect_rows = get_trim_rect_rows(src_gray, drink_rect_rows) ;
     }
 
 
@@ -743,16 +876,33 @@ int process_file(std::string infilepath, const std::string dest_dir) {
 
     //TODO: the price tags do not need to be sliced into rect, and would be more useful as a full strip.
 
-    if(cmdopt_write_files) {
+    if(cmdopt_write_files && is_sidecar) {
+        if(cmdopt_verbose) {
+            std::cout << "Writing container and price slot images warped from the original" << std::endl ;
+        }
+        write_slot_images(drink_image_rows, full_drink_rect_rows, infilepath, "dr000_") ;
+        write_slot_images(price_image_rows, full_price_rect_rows, infilepath, "pr000_") ;
+    } else if(cmdopt_write_files) {
+        //src is the input as decoded, so the rects can be cut from the file itself
+        const bool is_lossless = cmdopt_lossless_slots && can_crop_jpeg_losslessly(infilepath, src.size()) ;
+        if(cmdopt_lossless_slots && !is_lossless) {
+            std::cerr << "Cannot cut slot images losslessly from " << infilepath << ", re-encoding them" << std::endl ;
+        }
+
+        //a failed lossless write leaves no slot images behind, so re-encoding them all does not duplicate any
         if(cmdopt_verbose) {
             std::cout << "Writing container slot images" << std::endl ;
         }
-        write_slot_image_files(src, drink_rect_rows, infilepath, "dr000_") ;
+        if(!is_lossless || !write_slot_image_files_lossless(infilepath, drink_rect_rows, infilepath, "dr000_")) {
+            write_slot_image_files(src, drink_rect_rows, infilepath, "dr000_") ;
+        }
 
         if(cmdopt_verbose) {
             std::cout << "Writing price slot images" << std::endl ;
         }
-        write_slot_image_files(src, price_rect_rows, infilepath, "pr000_") ;
+        if(!is_lossless || !write_slot_image_files_lossless(infilepath, price_rect_rows, infilepath, "pr000_")) {
+            write_slot_image_files(src, price_rect_rows, infilepath, "pr000_") ;
+        }
     }
 
     // write_strip_image_file(src())
@@ -780,6 +930,111 @@ int process_file(std::string infilepath, const std::string dest_dir) {
     
 } //end of process_file
 
+/**
+ * @brief The sidecar written by fixperspective --homography-only for an input photo
+ * 
+ * @param sidecar_dir directory holding the sidecars
+ * @param infilepath the original photo
+ * @return std::string path of the .yml sidecar, or the .json one if only that exists
+ */
+std::string sidecar_path_for(const std::string &sidecar_dir, const std::string &infilepath) {
+    std::string path = infilepath ;
+    std::string name = basename(&path[0]) ;
+    std::string stem = sidecar_dir + PATH_SEPARATOR + name.substr(0, name.find_last_of(ext_sep)) ;
+
+    std::ifstream yml(stem + ".yml") ;
+    if(!yml && std::ifstream(stem + ".json")) {
+        return stem + ".json" ;
+    }
+
+    return stem + ".yml" ;
+}
+
+/**
+ * @brief The image fixperspective would have written, warped from the original at a reduced scale for detection
+ * 
+ * @param src_original 
+ * @param sidecar 
+ * @param scale 1.0 for full size
+ * @return Mat 
+ */
+Mat corrected_detection_image(const Mat &src_original, const perspective_sidecar &sidecar, float scale) {
+    const Rect rc_output = sidecar.output_rect() ;
+
+    //move the output rect to the origin, then scale
+    Mat scale_shift = Mat::eye(3, 3, CV_64F) ;
+    scale_shift.at<double>(0, 0) = scale ;
+    scale_shift.at<double>(1, 1) = scale ;
+    scale_shift.at<double>(0, 2) = -scale * rc_output.x ;
+    scale_shift.at<double>(1, 2) = -scale * rc_output.y ;
+
+    Mat hom ;
+    sidecar.homography.convertTo(hom, CV_64F) ;
+
+    Mat img_corrected ;
+    warpPerspective(src_original, img_corrected, scale_shift * hom, 
+        Size(cvRound(rc_output.width * scale), cvRound(rc_output.height * scale)), 
+        INTER_LINEAR, BORDER_CONSTANT, Scalar(255, 0, 255)) ;
+
+    return img_corrected ;
+}
+
+/**
+ * @brief Scale rects found on the detection image up to the full size output image
+ * 
+ * @param rect_rows 
+ * @param scale the scale of the detection image
+ * @param bounds size of the full size output image
+ * @return std::vector<std::vector<Rect> > 
+ */
+std::vector<std::vector<Rect> > scale_rect_rows(const std::vector<std::vector<Rect> > &rect_rows, float scale, Size bounds) {
+    const Rect rc_bounds = Rect(Point(0, 0), bounds) ;
+    std::vector<std::vector<Rect> > scaled_rows ;
+
+    for(const auto &row : rect_rows) {
+        std::vector<Rect> scaled_row ;
+        for(const auto &rc : row) {
+            Rect rc_scaled = Rect(cvRound(rc.x / scale), cvRound(rc.y / scale), 
+                cvRound(rc.width / scale), cvRound(rc.height / scale)) ;
+            scaled_row.push_back(rc_scaled & rc_bounds) ;
+        }
+        scaled_rows.push_back(scaled_row) ;
+    }
+
+    return scaled_rows ;
+}
+
+/**
+ * @brief Warp just the rects of the output image from the original photo
+ * 
+ * @param src_original 
+ * @param sidecar 
+ * @param rect_rows rects in the output image, which may be clipped from the full corrected image
+ * @param image_rows output, one image for each rect
+ */
+void warp_rect_rows(const Mat &src_original, const perspective_sidecar &sidecar, 
+    const std::vector<std::vector<Rect> > &rect_rows, std::vector<std::vector<Mat> > &image_rows) {
+    const Point output_origin = sidecar.output_rect().tl() ;
+
+    //all the rects go to warp_rois() together, so they are warped in parallel
+    std::vector<Rect> rois ;
+    for(const auto &row : rect_rows) {
+        for(const auto &rc : row) {
+            rois.push_back(rc + output_origin) ;
+        }
+    }
+
+    std::vector<Mat> images ;
+    warp_rois(src_original, sidecar.homography, rois, images) ;
+
+    image_rows.clear() ;
+    auto it_image = images.begin() ;
+    for(const auto &row : rect_rows) {
+        image_rows.push_back(std::vector<Mat>(it_image, it_image + row.size())) ;
+        it_image += row.size() ;
+    }
+}
+
 // int strip_detect
 void build_row_rects(const std::vector<int> sep_lines, int height, Point pt_strip_tl, std::vector<Rect> &rects_drinks, std::vector<Rect> &rects_prices) {
     int last_sep = sep_lines[0] ;
@@ -12,6 +12,7 @@ using namespace::cv ;
 
 #include <iostream>
 #include "extract_drinks_write.hpp"
+#include "jpeg_roi.hpp"
 
 extern std::string dest_dir ;
 extern int cmdopt_verbose ;
@@ -26,20 +27,82 @@ void write_slot_image_files(
     const std::string prefix
     ) 
     {
+    std::vector<std::vector<Mat> > images ;
+    for(const auto &rects : slot_image_rows) {
+        std::vector<Mat> row ;
+        for(const auto &rc : rects) {
+            row.push_back(src(rc)) ;
+        }
+        images.push_back(row) ;
+    }
+
+    write_slot_images(images, slot_image_rows, outfilepath, prefix) ;
+}
+
+/**
+ * @brief Write out slot images cut from the input JPEG without decoding and re-encoding them,
+ * so that they carry no further compression loss. See write_jpeg_lossless_crops().
+ * The origin of each slot is moved to an MCU boundary, and the file names have the moved origin.
+ * The input must not have been rotated or warped when read, see can_crop_jpeg_losslessly().
+ *
+ * @return true if all the slot images were written. If not, none are left, and they can all be re-encoded instead.
+ */
+bool write_slot_image_files_lossless(
+    const std::string &infilepath,
+    std::vector<std::vector<Rect> > slot_image_rows,
+    std::string outfilepath,
+    const std::string prefix
+    )
+    {
+	char *path = (char *)outfilepath.c_str() ;	//POSIX basename must be non-const
+    auto filenamestr = std::string(basename(path)) ;
+
+    //the row and slot of each rect, for naming
+    std::vector<Rect> rects ;
+    std::vector<Point> row_slots ;
+    for(size_t idx_row = 0 ; idx_row < slot_image_rows.size() ; idx_row++) {
+        for(size_t idx_slot = 0 ; idx_slot < slot_image_rows.at(idx_row).size() ; idx_slot++) {
+            rects.push_back(slot_image_rows.at(idx_row).at(idx_slot)) ;
+            row_slots.push_back(Point(idx_slot + 1, idx_row + 1)) ;
+        }
+    }
+
+    std::vector<Rect> crop_rects ;
+    return write_jpeg_lossless_crops(infilepath, rects,
+        [&](size_t idx, Rect rc_crop) {
+            return dest_dir + "/" + slot_image_filename(filenamestr, row_slots[idx].y, row_slots[idx].x, prefix, rc_crop) ;
+        }, crop_rects) ;
+}
+
+/**
+ * @brief Write out slot images which have already been cut out.
+ * The rects are those of the images in the full image, and only go into the file names. 
+ */
+void write_slot_images(
+    std::vector<std::vector<Mat> > slot_image_rows,
+    std::vector<std::vector<Rect> > slot_rect_rows,
+    std::string outfilepath,
+    const std::string prefix
+    ) 
+    {
     //Write out the drink images to files
 	char *path = (char *)outfilepath.c_str() ;	//POSIX basename must be non-const
     auto filenamestr = std::string(basename(path)) ;
 
     for(size_t idx_row = 0 ; idx_row < slot_image_rows.size() ; idx_row++) {
-        std::vector<Rect> rects = slot_image_rows.at(idx_row) ;
-        for(size_t idx_slot = 0 ; idx_slot < rects.size() ; idx_slot++) {
+        const std::vector<Mat> &images = slot_image_rows.at(idx_row) ;
+        const std::vector<Rect> &rects = slot_rect_rows.at(idx_row) ;
+        for(size_t idx_slot = 0 ; idx_slot < images.size() ; idx_slot++) {
+            if(images.at(idx_slot).empty()) {
+                continue ;
+            }
             Rect rc = rects.at(idx_slot) ;
             std::stringstream drink_filepath ;
             drink_filepath << dest_dir << "/" << slot_image_filename(filenamestr, idx_row + 1, idx_slot + 1, prefix, rc) ;
             if(cmdopt_verbose) {
                 // std::cout << drink_filepath.str() << std::endl ;
             }
-            imwrite(drink_filepath.str(), src(rc)) ;
+            imwrite(drink_filepath.str(), images.at(idx_slot)) ;
         }
     }
 }
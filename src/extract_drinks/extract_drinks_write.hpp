@@ -9,3 +9,17 @@ void write_slot_image_files(
     std::string outfilepath,
     const std::string prefix
     ) ;
+
+void write_slot_images(
+    std::vector<std::vector<cv::Mat> > slot_image_rows,
+    std::vector<std::vector<cv::Rect> > slot_rect_rows,
+    std::string outfilepath,
+    const std::string prefix
+    ) ;
+
+bool write_slot_image_files_lossless(
+    const std::string &infilepath,
+    std::vector<std::vector<cv::Rect> > slot_image_rows,
+    std::string outfilepath,
+    const std::string prefix
+    ) ;
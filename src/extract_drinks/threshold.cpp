@@ -1,50 +1,113 @@
 #if CV_VERSION_MAJOR >= 4
 #include <opencv4/opencv2/imgproc.hpp>
 #include <opencv4/opencv2/highgui.hpp>
+#include <opencv4/opencv2/core/hal/intrin.hpp>
 #else
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/core/hal/intrin.hpp>
 #endif
 
 #include <iostream>
+#include <vector>
+#include <mutex>
+#include <algorithm>
 
 using namespace cv ;
- /**
- Detect the threshold for extracting the highest highlight.
- We find the highest local minimum in the value histogram.
- Returns a value between 0 and 255
- */
-int detect_threshold(Mat img) {
+//pixels to histogram, above which only every few rows are sampled
+static const int THRESHOLD_SAMPLE_PIXELS = 1 << 20 ;
 
-    std::vector<Mat> hsv_planes ;
+/**
+ max(B, G, R) of each pixel of a row of a 3-channel image.
+ With SIMD, 16 pixels at a time are split into their channels by v_load_deinterleave().
+ */
+static void row_max_bgr(const uchar *p, uchar *row_max, int cols) {
+    int x = 0 ;
+#if CV_SIMD128
+    for( ; x + v_uint8x16::nlanes <= cols ; x += v_uint8x16::nlanes) {
+        v_uint8x16 b, g, r ;
+        v_load_deinterleave(p + 3 * x, b, g, r) ;
+        v_store(row_max + x, v_max(v_max(b, g), r)) ;
+    }
+#endif
+    for( ; x < cols ; x++) {
+        const uchar *px = p + 3 * x ;
+        row_max[x] = std::max(std::max(px[0], px[1]), px[2]) ;
+    }
+}
 
-	Mat img_hsv ;
-	cvtColor(img, img_hsv, COLOR_BGR2HSV) ;
-    split(img_hsv, hsv_planes) ;
+/**
+ Histogram of max(B, G, R), which is V in HSV, straight from the BGR image, without converting or splitting it.
+ Bands of rows are histogrammed in parallel, each into its own counts, which are summed at the end.
+ The counts of a band are kept in four interleaved sub-histograms, so that runs of equal values
+ do not wait on the increment of the same counter.
+ A large image is sampled every few whole rows, so that each sampled row is still read contiguously.
+ */
+static std::vector<int> max_channel_histogram(const Mat &img) {
+    std::vector<int> counts(256, 0) ;
+    std::mutex counts_mtx ;
+
+    const int channels = img.channels() ;
+    const int row_step = std::max(1, (int)(img.total() / THRESHOLD_SAMPLE_PIXELS)) ;
+    const int sampled_rows = (img.rows + row_step - 1) / row_step ;
+
+    parallel_for_(Range(0, sampled_rows), [&](const Range &range) {
+        int sub_counts[4][256] = {} ;
+        std::vector<uchar> row_max(img.cols) ;
+
+        for(int r = range.start ; r < range.end ; r++) {
+            const uchar *p = img.ptr<uchar>(r * row_step) ;
+            const uchar *values = row_max.data() ;
+
+            if(channels == 3) {
+                row_max_bgr(p, row_max.data(), img.cols) ;
+            } else if(channels > 3) {
+                for(int x = 0 ; x < img.cols ; x++) {
+                    const uchar *px = p + x * channels ;
+                    row_max[x] = std::max(std::max(px[0], px[1]), px[2]) ;
+                }
+            } else {
+                values = p ;
+            }
 
-	int histSize = 256 ; //1-dimensional, with 256 bins
-	// int histSize = 128 ; //1-dimensional, with 256 bins
+            int x = 0 ;
+            for( ; x + 4 <= img.cols ; x += 4) {
+                sub_counts[0][values[x]]++ ;
+                sub_counts[1][values[x + 1]]++ ;
+                sub_counts[2][values[x + 2]]++ ;
+                sub_counts[3][values[x + 3]]++ ;
+            }
+            for( ; x < img.cols ; x++) {
+                sub_counts[0][values[x]]++ ;
+            }
+        }
 
-	const float range[] = { 0, 256 } ; //each bin can contain a value n wher 0 > n > 256
-    const float* hist_range = { range } ;//only 
+        std::lock_guard<std::mutex> lock(counts_mtx) ;
+        for(int i = 0 ; i < 256 ; i++) {
+            counts[i] += sub_counts[0][i] + sub_counts[1][i] + sub_counts[2][i] + sub_counts[3][i] ;
+        }
+    }) ;
 
-	Mat hist_val ;
-    Mat img_value = hsv_planes[2] ;
+    return counts ;
+}
 
-	calcHist(&img_value, 1, 0, Mat(), hist_val, 1, &histSize, &hist_range, true, false) ;
+ /**
+ Detect the threshold for extracting the highest highlight.
+ We find the highest local minimum in the value histogram.
+ Returns a value between 0 and 255
+ */
+int detect_threshold(Mat img) {
+    const int histSize = 256 ; //1-dimensional, with 256 bins
 
-    // for(int i = 0 ; i < 32 ; i++) {
-    //     std::cout << hist_val.at<float>(i) << ", ";
-    // }
-    // std::cout << std::endl ;
+    const std::vector<int> hist_val = max_channel_histogram(img) ;
 
     //scan from the max downward for the first local minimum
     const int MAX_OFFSET = 4 ;
     int last_idx = histSize - MAX_OFFSET ;
-    float last_val = hist_val.at<int>(last_idx) ;
+    int last_val = hist_val[last_idx] ;
     int min_idx = last_idx ;
     for( int i = last_idx; i >= 0 ; i--) {
-        float this_val = hist_val.at<float>(i) ;
+        int this_val = hist_val[i] ;
         // std::cout << i << ":" << this_val << ", " ;
         if(this_val > last_val) {
             min_idx = i ;
@@ -55,25 +118,6 @@ int detect_threshold(Mat img) {
 
     // std::cout << "Detected threshold:" << min_idx << std::endl ;
 
-    /*
-    int hist_w = 512, hist_h = 200;
-    Mat histImage( hist_h, hist_w, CV_8UC3, Scalar( 0,0,0) );
-    normalize(hist_val, hist_val, 0, histImage.rows, NORM_MINMAX, -1, Mat() );
-
-
-    int bin_w = cvRound( (double) hist_w/histSize );
-    for( int i = 1; i < histSize; i++ )
-    {
-        line( histImage, 
-                Point( bin_w*(i-1), hist_h - cvRound(hist_val.at<float>(i-1)) ),
-                Point( bin_w*(i), hist_h - cvRound(hist_val.at<float>(i)) ),
-                Scalar( 255, 255, 192), 2, 8, 0  );
-    }
-
-
-    imshow("calcHist Demo", histImage );
-    waitKey();
-    */
     int scale = 256 / histSize ;
 
 	min_idx *= scale;
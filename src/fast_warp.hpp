@@ -0,0 +1,15 @@
+/**
+ * @file fast_warp.hpp
+ * @brief Perspective warp of 8-bit images with fixed-point interpolation, as a faster replacement for warpPerspective()
+ * @version 0.1
+ * @date 2026-10-19
+ * 
+ */
+
+#pragma once
+
+const int FAST_WARP_NEAREST = 0 ;	//preview quality
+const int FAST_WARP_BILINEAR = 1 ;
+
+void fast_warp_perspective(const cv::Mat &src, cv::Mat &dst, const cv::Mat &hom, cv::Size dsize, 
+	int quality = FAST_WARP_BILINEAR, cv::Scalar fill = cv::Scalar(255, 0, 255)) ;
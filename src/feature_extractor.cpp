@@ -0,0 +1,194 @@
+/**
+ * @file feature_extractor.cpp
+ * @brief Features computed from a drink image for matching, each by a named extractor from a registry.
+ *
+ * Built in, from the cheapest:
+ *   color_moments: mean, standard deviation and skewness of each HSV channel
+ *   thumbnail: the image reduced to 8 x 8 BGR
+ *   gradient_orientation: 9-bin histogram of gradient orientations weighted by magnitude
+ *   hs_histograms: the H-S histograms of the full image and five regions, as generate_histogram_set()
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgproc.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#endif
+
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <cmath>
+
+using namespace cv ;
+
+#include "histogram.hpp"
+#include "feature_extractor.hpp"
+
+class HSHistogramsExtractor : public FeatureExtractor {
+public:
+	std::string name() const { return HS_HISTOGRAMS_FEATURE ; }
+
+	std::vector<std::string> labels() const {
+		return std::vector<std::string>(yaml_labels, yaml_labels + num_histogram_regions) ;
+	}
+
+	std::vector<Mat> extract(const Mat &img) const {
+		return generate_histogram_set(img, HS_HUE_BINS, HS_SAT_BINS) ;
+	}
+} ;
+
+class ColorMomentsExtractor : public FeatureExtractor {
+public:
+	std::string name() const { return "color_moments" ; }
+	std::vector<std::string> labels() const { return { "feature_color_moments" } ; }
+
+	std::vector<Mat> extract(const Mat &img) const {
+		Mat hsv ;
+		cvtColor(img, hsv, COLOR_BGR2HSV) ;
+		hsv.convertTo(hsv, CV_32F) ;
+
+		Mat moments(1, 9, CV_32F) ;
+		std::vector<Mat> planes ;
+		split(hsv, planes) ;
+
+		for(int c = 0 ; c < 3 ; c++) {
+			Scalar mu, sigma ;
+			meanStdDev(planes[c], mu, sigma) ;
+
+			Mat centered ;
+			subtract(planes[c], mu, centered) ;
+			Mat cubed ;
+			pow(centered, 3, cubed) ;
+			const double third = mean(cubed)[0] ;
+
+			moments.at<float>(c * 3) = mu[0] ;
+			moments.at<float>(c * 3 + 1) = sigma[0] ;
+			moments.at<float>(c * 3 + 2) = std::cbrt(third) ;
+		}
+		return { moments } ;
+	}
+} ;
+
+class ThumbnailExtractor : public FeatureExtractor {
+public:
+	std::string name() const { return "thumbnail" ; }
+	std::vector<std::string> labels() const { return { "feature_thumbnail" } ; }
+
+	std::vector<Mat> extract(const Mat &img) const {
+		Mat thumb ;
+		resize(img, thumb, Size(8, 8), 0, 0, INTER_AREA) ;
+		thumb.convertTo(thumb, CV_32F) ;
+		return { thumb.reshape(1, 1) } ;
+	}
+} ;
+
+class GradientOrientationExtractor : public FeatureExtractor {
+public:
+	std::string name() const { return "gradient_orientation" ; }
+	std::vector<std::string> labels() const { return { "feature_gradient_orientation" } ; }
+
+	std::vector<Mat> extract(const Mat &img) const {
+		const int num_bins = 9 ;
+
+		Mat gray, dx, dy, magnitude, angle ;
+		cvtColor(img, gray, COLOR_BGR2GRAY) ;
+		Sobel(gray, dx, CV_32F, 1, 0) ;
+		Sobel(gray, dy, CV_32F, 0, 1) ;
+		cartToPolar(dx, dy, magnitude, angle, true) ;
+
+		//unsigned orientation, 0 to 180 degrees
+		Mat hist = Mat::zeros(1, num_bins, CV_32F) ;
+		for(int y = 0 ; y < angle.rows ; y++) {
+			const float *a = angle.ptr<float>(y) ;
+			const float *m = magnitude.ptr<float>(y) ;
+			for(int x = 0 ; x < angle.cols ; x++) {
+				const int bin = int(std::fmod(a[x], 180.0f) * num_bins / 180.0f) % num_bins ;
+				hist.at<float>(bin) += m[x] ;
+			}
+		}
+		normalize(hist, hist, 1, 0, NORM_L1) ;
+		return { hist } ;
+	}
+} ;
+
+/**
+ * @brief The registry, created with the built-in extractors on first use.
+ * Extractors are shared, so that one replaced while a caller still uses it lives until that caller is done.
+ */
+static std::map<std::string, std::shared_ptr<const FeatureExtractor> > &extractor_registry(std::unique_lock<std::mutex> &lock) {
+	static std::mutex mtx ;
+	static std::map<std::string, std::shared_ptr<const FeatureExtractor> > extractor_of ;
+
+	lock = std::unique_lock<std::mutex>(mtx) ;
+	if(extractor_of.empty()) {
+		std::unique_ptr<FeatureExtractor> builtins[] = {
+			std::unique_ptr<FeatureExtractor>(new HSHistogramsExtractor()),
+			std::unique_ptr<FeatureExtractor>(new ColorMomentsExtractor()),
+			std::unique_ptr<FeatureExtractor>(new ThumbnailExtractor()),
+			std::unique_ptr<FeatureExtractor>(new GradientOrientationExtractor())
+		} ;
+		for(auto &extractor : builtins) {
+			const std::string name = extractor->name() ;
+			extractor_of[name] = std::move(extractor) ;
+		}
+	}
+	return extractor_of ;
+}
+
+/**
+ * @brief Add an extractor, or replace the one of the same name
+ */
+void register_feature_extractor(std::unique_ptr<FeatureExtractor> extractor) {
+	std::unique_lock<std::mutex> lock ;
+	auto &extractor_of = extractor_registry(lock) ;
+	const std::string name = extractor->name() ;
+	extractor_of[name] = std::move(extractor) ;
+}
+
+/**
+ * @brief The extractor of a name, or an empty pointer if there is none
+ */
+std::shared_ptr<const FeatureExtractor> feature_extractor(const std::string &name) {
+	std::unique_lock<std::mutex> lock ;
+	auto &extractor_of = extractor_registry(lock) ;
+	auto it = extractor_of.find(name) ;
+	return (it == extractor_of.end()) ? nullptr : it->second ;
+}
+
+std::vector<std::string> feature_extractor_names() {
+	std::unique_lock<std::mutex> lock ;
+	std::vector<std::string> names ;
+	for(const auto &pair : extractor_registry(lock)) {
+		names.push_back(pair.first) ;
+	}
+	return names ;
+}
+
+/**
+ * @brief Split a comma-separated list of extractor names, dropping those not registered
+ */
+std::vector<std::string> parse_feature_names(const std::string &names) {
+	std::vector<std::string> result ;
+	std::stringstream ss(names) ;
+	std::string name ;
+
+	while(std::getline(ss, name, ',')) {
+		if(name.empty()) {
+			continue ;
+		}
+		if(!feature_extractor(name)) {
+			std::cerr << "Unknown feature: " << name << std::endl ;
+			continue ;
+		}
+		result.push_back(name) ;
+	}
+	return result ;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file feature_extractor.hpp
+ * @brief Features computed from a drink image for matching, each by a named extractor from a registry
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+//bins of the H-S histograms
+const int HS_HUE_BINS = 10 ;
+const int HS_SAT_BINS = 12 ;
+
+//name of the H-S histogram set, which every catalog holds
+const char *const HS_HISTOGRAMS_FEATURE = "hs_histograms" ;
+
+/**
+ * @brief Computes one kind of feature from an image, as one or more Mats.
+ * Each Mat is stored in the catalog under the label at the same index.
+ */
+class FeatureExtractor {
+public:
+	virtual ~FeatureExtractor() {}
+
+	virtual std::string name() const = 0 ;
+	virtual std::vector<std::string> labels() const = 0 ;
+	virtual std::vector<cv::Mat> extract(const cv::Mat &img) const = 0 ;
+} ;
+
+void register_feature_extractor(std::unique_ptr<FeatureExtractor> extractor) ;
+std::shared_ptr<const FeatureExtractor> feature_extractor(const std::string &name) ;
+std::vector<std::string> feature_extractor_names() ;
+std::vector<std::string> parse_feature_names(const std::string &names) ;
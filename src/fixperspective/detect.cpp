@@ -227,6 +227,25 @@ void detect_lines(Mat img_edges, std::vector<Vec4i> &lines, int threshold, int s
 	lines.erase(slant_iter, lines.end()) ;
 }
 
+/**
+ * @brief Canny edges which also give the gradient images they were computed from,
+ * so that the orientation of each edge pixel is available without another Sobel pass.
+ * 
+ * @param img single channel image
+ * @param img_edges output edge image, CV_8UC1
+ * @param img_dx output horizontal gradient, CV_16SC1
+ * @param img_dy output vertical gradient, CV_16SC1
+ * @param threshold1 lower hysteresis threshold, as for Canny()
+ * @param threshold2 upper hysteresis threshold
+ */
+void detect_edges_oriented(Mat img, Mat &img_edges, Mat &img_dx, Mat &img_dy, double threshold1, double threshold2) {
+	//the same 3x3 aperture Canny() uses internally
+	Sobel(img, img_dx, CV_16S, 1, 0, 3) ;
+	Sobel(img, img_dy, CV_16S, 0, 1, 3) ;
+
+	Canny(img_dx, img_dy, img_edges, threshold1, threshold2) ;
+}
+
 /**
  * @brief Return a value indicating how likely it is that the photograph depicts
  * a vending machine at night with the display panel illumination on. 
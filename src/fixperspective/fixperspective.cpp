@@ -13,11 +13,13 @@
 #include <opencv4/opencv2/highgui.hpp>
 #include <opencv4/opencv2/imgproc.hpp>
 #include <opencv4/opencv2/calib3d.hpp>
+#include <opencv4/opencv2/videoio.hpp>
 // #include <opencv4/opencv2/viz/types.hpp>
 #else
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/videoio/videoio.hpp>
 // #include <opencv2/viz/types.hpp>
 #endif
 
@@ -27,6 +29,7 @@
 
 #include <string>
 #include <iostream>
+#include <fstream>
 #include <unistd.h>
 #include <libgen.h>
 #include <getopt.h>
@@ -34,7 +37,14 @@
 #include "../lines.hpp"
 #include "detect.hpp"
 #include "perspective_lines.hpp"
+#include "ortho_hough.hpp"
 #include "cabinet.hpp"
+#include "track.hpp"
+#include "../warp_roi.hpp"
+#include "../fast_warp.hpp"
+#include "../jpeg_exif.hpp"
+#include "../mat_pool.hpp"
+#include "../debug_sink.hpp"
 
 
 #ifdef USE_GUI
@@ -55,16 +65,21 @@ using namespace cv ;
 
 /* local function declarations */
 int process_file(char *src_file, const char *dest_file) ;
+int process_video(char *src_file, const char *dest_file) ;
+int process_image_homography(Mat src, const char *src_file, const char *dest_file) ;
 Mat process_image(Mat img, std::string src_file_base) ;
+std::vector<Vec4i> detect_bounding_lines(Mat src, std::string src_file_base) ;
+Mat perspective_homography(Size img_size, Vec4i top, Vec4i bottom, Vec4i left, Vec4i right,
+	Size &corrected_image_size, std::vector<Point2f> &src_quad_points, std::vector<Point2f> &dst_rect_points) ;
 Mat transform_perspective(Mat img, Vec4i top, Vec4i bottom, Vec4i left, Vec4i right, bool is_clip = true) ;
 inline Mat transform_perspective(Mat img, const std::vector<Vec4i>lines_tblr) {
   return transform_perspective(img, lines_tblr[0], lines_tblr[1], lines_tblr[2], lines_tblr[3]) ;
 }
-// std::vector<Vec4i> detect_bounding_lines(Mat src, int hough_threshold = 50) ;
 // std::vector<Vec4i> detect_bounding_lines_iterate_scale(const Mat img_src) ;
 std::vector<Point2f> line_corners(Vec4i top, Vec4i bottom, Vec4i left, Vec4i right) ;
-Rect rect_within_image(Mat img, Mat corrected_img, std::vector<Point2f> src_quad_pts, std::vector<Point2f> dst_rect_pts) ;
+Rect rect_within_image(Size img_size, Size corrected_size, std::vector<Point2f> src_quad_pts, std::vector<Point2f> dst_rect_pts) ;
 Rect trim_dense_edges(Mat src) ;
+void benchmark_warp(Mat img, Mat warped_fast, Mat hom, Size corrected_image_size, int warp_quality, double msec_fast) ;
 
 #ifdef USE_EXIV2
 bool copy_exif(std::string src_path, std::string dest_path) ;
@@ -78,6 +93,10 @@ const char *DEFAULT_DEST_DIR = "corrected" ;
 
 const std::string path_separator = std::string("/") ;
 
+//In video mode, the search band for tracking lines is this percentage of the shorter side of the frame
+const int TRACK_BAND_PERCENT = 3 ;
+const int TRACK_MIN_BAND = 8 ;
+
 
 // void draw_line(Mat image, Vec4i l, Scalar color, int width) {
 //     line(image, Point(l[0], l[1]), Point(l[2], l[3]), color, width, CV_8S);
@@ -97,8 +116,16 @@ void help() {
 	std::cout << "  -b : batch mode (no display)" << std::endl ;
 	std::cout << "  -c : clip image to transform borders" << std::endl ;
 	std::cout << "  -d dir : batch mode target directory" << std::endl ;
+	std::cout << "  -D dir : write debug images to a subdirectory of dir for each input (default: <target>/debug)" << std::endl ;
+	std::cout << "  -e names : debug images to write, comma-separated, or all (default with -D: all)" << std::endl ;
+	std::cout << "       dense, edges, merged, bounds" << std::endl ;
 	std::cout << "  -n : test mode; do not write file" << std::endl ;
 	std::cout << "  -v : verbose messages" << std::endl ;
+	std::cout << "  -V : video mode; inputs are video files or numbered frame patterns such as frame_%04d.jpg." << std::endl ;
+	std::cout << "       Writes a per-frame homography CSV instead of corrected images" << std::endl ;
+	std::cout << "  --homography-only[=yaml|json] : write only the homography, corners and clip rect" << std::endl ;
+	std::cout << "       to a sidecar file in the target directory, without warping the image" << std::endl ;
+	std::cout << "  --benchmark-warp : time the warp against OpenCV warpPerspective and report the difference" << std::endl ;
 	exit(0) ;
 }
 
@@ -112,7 +139,29 @@ bool cmdopt_batch = false ;
 bool cmdopt_clip = false ;
 bool cmdopt_verbose = false ;
 bool cmdopt_nowrite = false ;
+bool cmdopt_video = false ;
+bool cmdopt_homography_only = false ;
+bool cmdopt_benchmark_warp = false ;
+std::string homography_sidecar_ext = "yml" ;
+std::string cmdoptval_debug_dir ;
+std::string cmdoptval_debug_images ;
+
+
+/**
+ * @brief The name of a video file or frame sequence pattern without its directory, extension, or frame number field
+ * 
+ * @param filename a path such as burst/IMG_1234.mov or burst/frame_%04d.jpg
+ * @return std::string IMG_1234, or frame_
+ */
+std::string video_stem(const char *filename) {
+	std::string path(filename) ;
+	std::string stem(basename(&path[0])) ;
 
+	stem = stem.substr(0, stem.find('%')) ;
+	stem = stem.substr(0, stem.find_last_of('.')) ;
+
+	return stem.empty() ? std::string("frames") : stem ;
+}
 
 int main(int argc, char **argv) {
 	char *cvalue = NULL ;
@@ -122,22 +171,37 @@ int main(int argc, char **argv) {
 	//test() ; exit(0);
 
 	dest_dir = DEFAULT_DEST_DIR ;
+
+	//reuse the buffers of the temporary images from one photo to the next
+	install_mat_pool() ;
 	
-	const char *opts =  "bcd:nv";
+	const char *opts =  "bcd:D:e:nvV";
+
+	const int LONGOPT_HOMOGRAPHY_ONLY = 256 ;
+	const int LONGOPT_BENCHMARK_WARP = 257 ;
 
-	//not implemented yet
 	static struct option long_options[] = {
-		{"add",     required_argument, 0,  0 },
-		{"append",  no_argument,       0,  0 },
-		{"delete",  required_argument, 0,  0 },
-		{"verbose", no_argument,       0,  0 },
-		{"create",  required_argument, 0, 'c'},
-		{"file",    required_argument, 0,  0 },
-		{0,         0,                 0,  0 }
+		{"homography-only", optional_argument, 0, LONGOPT_HOMOGRAPHY_ONLY },
+		{"benchmark-warp",  no_argument,       0, LONGOPT_BENCHMARK_WARP },
+		{"verbose",         no_argument,       0, 'v'},
+		{0,                 0,                 0,  0 }
 	};
 
-	while((c = getopt(argc, argv, opts)) != -1) {
+	while((c = getopt_long(argc, argv, opts, long_options, NULL)) != -1) {
 		switch(c) {
+			case LONGOPT_BENCHMARK_WARP :
+				cmdopt_benchmark_warp = true ;
+				break ;
+			case LONGOPT_HOMOGRAPHY_ONLY :
+				cmdopt_homography_only = true ;
+				if(optarg) {
+					homography_sidecar_ext = (std::string(optarg) == "yaml") ? "yml" : optarg ;
+					if(homography_sidecar_ext != "yml" && homography_sidecar_ext != "json") {
+						std::cerr << "Unknown sidecar format: " << optarg << std::endl ;
+						help() ;
+					}
+				}
+				break ;
 			case 'b':
 				cmdopt_batch = true ;
 				break;
@@ -148,6 +212,12 @@ int main(int argc, char **argv) {
 				cvalue = optarg ;
 				dest_dir = cvalue ;
 				break ;
+			case 'D':
+				cmdoptval_debug_dir = optarg ;
+				break ;
+			case 'e':
+				cmdoptval_debug_images = optarg ;
+				break ;
 			case 'n':
 				cmdopt_nowrite = true ;
 				break;
@@ -155,6 +225,11 @@ int main(int argc, char **argv) {
 				cmdopt_verbose = true ;
 				std::cout << "Verbose mode" << std::endl ;
 				break ;
+			case 'V' :
+				cmdopt_video = true ;
+				//there is no stopping to look at each frame
+				cmdopt_batch = true ;
+				break ;
 		}
 	}
 
@@ -162,6 +237,11 @@ int main(int argc, char **argv) {
 		std::cerr << "No input files" << std::endl ; 
 		help() ;
 	}
+
+	if(!cmdoptval_debug_dir.empty() || !cmdoptval_debug_images.empty()) {
+		debug_sink().set_output_dir(cmdoptval_debug_dir.empty() ? std::string(dest_dir) + "/debug" : cmdoptval_debug_dir) ;
+		debug_sink().enable(cmdoptval_debug_images.empty() ? "all" : cmdoptval_debug_images) ;
+	}
 	
 	for (int idx = optind ; idx < argc ; idx++) {
 		char *filename ;
@@ -169,16 +249,33 @@ int main(int argc, char **argv) {
 		
 		std::stringstream dest_path ;
 		
+		if(cmdopt_video) {
+			dest_path << dest_dir << "/" << video_stem(filename) << ".homography.csv" ;
+
+			auto result = process_video(filename, dest_path.str().c_str()) ;
+			if(result) {
+				std::cerr << "Failed at processing " << filename << std::endl ;
+			}
+			continue ;
+		}
+
 		if(!cmdopt_nowrite) {		
 			dest_path << dest_dir << "/" << basename(filename) ;
 		}
 	
 		// std::cout << filename << std::endl ;
+		debug_sink().begin_input(filename) ;
 		auto result = process_file(filename, dest_path.str().c_str()) ;
 		if(result) {
 			std::cerr << "Failed at processing " << filename << std::endl ;
 		}
 	}
+
+	debug_sink().flush() ;
+
+	if(cmdopt_verbose) {
+		mat_pool()->print_stats(std::cout) ;
+	}
 }
 
 int process_file(char *filename, const char *dest_file) {
@@ -201,6 +298,10 @@ int process_file(char *filename, const char *dest_file) {
 		std::cout << "Dimensions (cols x rows): " << src.cols << " : " << src.rows << std::endl ;
 	}
 
+	if(cmdopt_homography_only) {
+		return process_image_homography(src, filename, dest_file) ;
+	}
+
 	Mat img_result = process_image(src, filenamestr) ;
 
 	if(img_result.empty()) {
@@ -212,6 +313,21 @@ int process_file(char *filename, const char *dest_file) {
 			std::cout << "Writing to:[" << dest_file << "]" << std::endl ;
 		}
 
+		//JPEG to JPEG: the EXIF segment goes into the encoded stream, and the file is written once
+		std::vector<uchar> exif_segment ;
+		if(is_jpeg_path(dest_file) && read_exif_segment(filename, exif_segment)) {
+			if(!patch_exif_segment(exif_segment, img_result.size())) {
+				std::cerr << "Could not parse EXIF in " << filename << ", not copied" << std::endl ;
+				exif_segment.clear() ;
+			}
+
+			if(!write_jpeg_with_exif(dest_file, img_result, exif_segment)) {
+				std::cerr << "Could not write image data to " << dest_file << std::endl ;
+				return ERR_PROCESSFILE_NO_DESTFILE ; 
+			}
+			return 0 ;
+		}
+
 		auto result_imwrite = imwrite(dest_file, img_result) ;
 		if(!result_imwrite) { 
 			std::cerr << "Could not write image data to " << dest_file << std::endl ;
@@ -230,15 +346,252 @@ int process_file(char *filename, const char *dest_file) {
 	return 0 ;
 }
 
-Mat process_image(Mat src, std::string src_file_base) {	
-	//add images to this dict, we can show them at the end,
-	//or write them out to files on a headless system
-	std::map<std::string, Mat> img_debug_of ;
+/**
+ * @brief Follow the cabinet through a video or a numbered sequence of frames, and write the homography for each frame.
+ * The first frame, and any frame on which the bounding lines are lost, gets the full detection of process_image().
+ * Other frames only refine the previous frame's lines within a narrow band.
+ * 
+ * The output is CSV, one row per frame:
+ * frame, source (detect / track / lost), confidence, corrected width, corrected height, then the homography row by row.
+ * 
+ * @param filename anything VideoCapture can open
+ * @param dest_file the CSV file to write
+ * @return int 0 on success
+ */
+int process_video(char *filename, const char *dest_file) {
+	VideoCapture cap(filename) ;
+
+	if(!cap.isOpened()) {
+		std::cerr << "Could not open video or frame sequence: " << filename << std::endl ;
+		return ERR_PROCESSFILE_NO_INPUT ;
+	}
+
+	std::ofstream out ;
+
+	if(!cmdopt_nowrite) {
+		if(cmdopt_verbose) {
+			std::cout << "Writing homographies to:[" << dest_file << "]" << std::endl ;
+		}
+
+		out.open(dest_file) ;
+		if(!out) {
+			std::cerr << "Could not open " << dest_file << std::endl ;
+			return ERR_PROCESSFILE_NO_DESTFILE ;
+		}
+
+		out << "frame,source,confidence,width,height,h00,h01,h02,h10,h11,h12,h20,h21,h22" << std::endl ;
+	}
+
+	const std::string src_file_base = video_stem(filename) ;
+
+	Mat frame, frame_gray ;
+	std::vector<Vec4i> lines_tblr ;	//empty when there is nothing to track
+	int num_frames = 0, num_detected = 0, num_tracked = 0, num_lost = 0 ;
+
+	for(int frame_idx = 0 ; cap.read(frame) ; frame_idx++) {
+		num_frames++ ;
+		cvtColor(frame, frame_gray, COLOR_BGR2GRAY) ;
+
+		const int band = std::max(TRACK_MIN_BAND, std::min(frame.rows, frame.cols) * TRACK_BAND_PERCENT / 100) ;
+
+		std::string source = "track" ;
+		float confidence = 0 ;
+
+		if(!lines_tblr.empty()) {
+			std::vector<Vec4i> tracked_tblr = lines_tblr ;
+			confidence = track_bounding_lines(frame_gray, tracked_tblr, band) ;
+
+			if(confidence >= TRACK_MIN_CONFIDENCE) {
+				lines_tblr = tracked_tblr ;
+			} else {
+				lines_tblr.clear() ;
+			}
+		}
+
+		//keyframe, or tracking was lost, in which case this same frame is detected rather than the next
+		if(lines_tblr.empty()) {
+			if(cmdopt_verbose) {
+				std::cout << "Frame " << frame_idx << ": full detection" << std::endl ;
+			}
+			lines_tblr = detect_bounding_lines(frame, src_file_base + "#" + std::to_string(frame_idx)) ;
+			source = "detect" ;
+			confidence = 1 ;
+		}
+
+		Mat hom ;
+		Size corrected_image_size ;
+		std::vector<Point2f> src_quad_points, dst_rect_points ;
+
+		if(!lines_tblr.empty()) {
+			hom = perspective_homography(frame.size(), lines_tblr[0], lines_tblr[1], lines_tblr[2], lines_tblr[3],
+				corrected_image_size, src_quad_points, dst_rect_points) ;
+		}
+
+		if(hom.empty()) {
+			lines_tblr.clear() ;
+			num_lost++ ;
+
+			if(out.is_open()) {
+				out << frame_idx << ",lost,0,0,0,,,,,,,,," << std::endl ;
+			}
+			continue ;
+		}
+
+		if(source == "detect") {
+			num_detected++ ;
+		} else {
+			num_tracked++ ;
+		}
+
+		if(out.is_open()) {
+			out << frame_idx << "," << source << "," << confidence << "," 
+				<< corrected_image_size.width << "," << corrected_image_size.height ;
+			for(int r = 0 ; r < 3 ; r++) {
+				for(int c = 0 ; c < 3 ; c++) {
+					out << "," << hom.at<double>(r, c) ;
+				}
+			}
+			out << std::endl ;
+		}
+	}
+
+	std::cout << src_file_base << ": " << num_frames << " frames, " << num_detected << " detected, " 
+		<< num_tracked << " tracked, " << num_lost << " lost" << std::endl ;
+
+	if(num_frames == 0) {
+		return ERR_PROCESSFILE_NO_INPUT ;
+	}
+
+	return 0 ;
+}
+
+/**
+ * @brief Find the bounding lines of the cabinet, and write a sidecar with the homography and its rectangles
+ * instead of warping the image. The warp can be done later, or only for the parts needed, with warp_roi().
+ * 
+ * @param src color image
+ * @param filename path of the source image, recorded in the sidecar
+ * @param dest_file path the corrected image would have been written to. The sidecar goes alongside it.
+ * @return int 0 on success
+ */
+int process_image_homography(Mat src, const char *filename, const char *dest_file) {
+	std::string path(filename) ;
+	auto lines_tblr = detect_bounding_lines(src, std::string(basename(&path[0]))) ;
+
+	if(lines_tblr.empty()) {
+		return ERR_PROCESSFILE_IMAGE_FAIL ;
+	}
+
+	perspective_sidecar sidecar ;
+	std::vector<Point2f> dst_rect_points ;
+
+	sidecar.source_image_path = filename ;
+	sidecar.source_size = src.size() ;
+	sidecar.homography = perspective_homography(src.size(), lines_tblr[0], lines_tblr[1], lines_tblr[2], lines_tblr[3],
+		sidecar.corrected_size, sidecar.src_quad, dst_rect_points) ;
+
+	if(sidecar.homography.empty()) {
+		return ERR_PROCESSFILE_IMAGE_FAIL ;
+	}
+
+	sidecar.dst_rect = Rect2f(dst_rect_points[0], dst_rect_points[2]) ;
+	sidecar.clip_rect = rect_within_image(src.size(), sidecar.corrected_size, sidecar.src_quad, dst_rect_points) ;
+	sidecar.is_clipped = cmdopt_clip ;
+
+	if(cmdopt_nowrite) {
+		return 0 ;
+	}
+
+	std::string sidecar_path(dest_file) ;
+	sidecar_path = sidecar_path.substr(0, sidecar_path.find_last_of('.')) + "." + homography_sidecar_ext ;
+
+	if(cmdopt_verbose) {
+		std::cout << "Writing homography to:[" << sidecar_path << "]" << std::endl ;
+	}
+
+	if(!write_perspective_sidecar(sidecar, sidecar_path)) {
+		return ERR_PROCESSFILE_NO_DESTFILE ;
+	}
+
+	return 0 ;
+}
+
+/**
+ * @brief Find the bounding lines of the cabinet and correct the perspective so that they are orthogonal
+ * 
+ * @param src color image
+ * @param src_file_base name for labelling windows
+ * @return Mat the corrected image, or empty if the lines could not be found
+ */
+Mat process_image(Mat src, std::string src_file_base) {
+	auto lines_tblr = detect_bounding_lines(src, src_file_base) ;
+
+	if(lines_tblr.empty()) {
+		return Mat() ;
+	}
+
+	//transform
+	Mat img_transformed = transform_perspective(src, 
+		lines_tblr[0], 
+		lines_tblr[1], 
+		lines_tblr[2], 
+		lines_tblr[3],
+		cmdopt_clip) ;
+
+	/*
+	std::cout << "Trimming away dense background." << std::endl ;
+	Rect rc_dense_trim = trim_dense_edges(transformed_image) ;
+	transformed_image = transformed_image(rc_dense_trim) ;
+	*/
+
+	#ifdef USE_GUI
+	if(!cmdopt_batch) {
+		std::string label = "👍 Corrected Image: " + src_file_base ;
+		imshow(label, scale_for_display(img_transformed)) ;
+
+		waitKey() ;
+	}
+	#endif
+
+	std::cout << "process_image() : Finished processing: " << src_file_base << std::endl ;
+
+	return img_transformed ;
+}
+
+/**
+ * @brief Draw lines for the debug sink, which does not depend on the GUI drawing functions
+ */
+static void draw_debug_lines(Mat &img, const std::vector<Vec4i> &lines, Scalar color) {
+	for(const auto &lin : lines) {
+		line(img, Point(lin[0], lin[1]), Point(lin[2], lin[3]), color, 3) ;
+	}
+}
+
+static void draw_debug_lines(Mat &img, const std::vector<ortho_line> &plines, Scalar color) {
+	for(const auto &lin : plines) {
+		line(img, lin.origin(), lin.end(), color, 3) ;
+	}
+}
 
+/**
+ * @brief Detect the lines of the four edges of the cabinet
+ * 
+ * @param src color image
+ * @param src_file_base name for labelling windows
+ * @return std::vector<Vec4i> top, bottom, left, right lines, or empty if they could not be found
+ */
+std::vector<Vec4i> detect_bounding_lines(Mat src, std::string src_file_base) {	
+	//feedback images are shown in windows in interactive mode,
+	//and offered to the debug sink, which writes the enabled ones to files
+	#ifdef USE_GUI
 	//for marking up and displaying feedback images
 	const char *channel_img_names[] = {
 		"gray (C)", "hue (Y)", "val (M)", "blue", "green", "red"
 	} ;
+	const bool is_feedback = !cmdopt_batch ;
+	#else
+	const bool is_feedback = false ;
+	#endif
 
 	//prepare the images
   //convert to value or hue channel?
@@ -250,17 +603,12 @@ Mat process_image(Mat src, std::string src_file_base) {
 
 	cvtColor(src, img_hsv, COLOR_BGR2HSV) ;	//we will overwrite with just the hue channel
 
-	std::vector<Mat> hsv_planes, bgr_planes;
+	std::vector<Mat> hsv_planes ;
 
 	split(img_hsv, hsv_planes );
 	Mat img_hue = hsv_planes[0] ;
 	Mat img_val = hsv_planes[2] ;
 
-	split(src, bgr_planes) ;
-	Mat img_blue = bgr_planes[0] ;
-	Mat img_green = bgr_planes[1] ;
-	Mat img_red = bgr_planes[2] ;
-
 	Mat imgs[] = {
 		img_gray,
 		img_hue,
@@ -273,11 +621,6 @@ Mat process_image(Mat src, std::string src_file_base) {
 	// blur(img_gray, img_gray, Size(3, 3));
 	// blur(img_hue, img_hue, Size(3, 3));
 
-	//a test image for plotting lines. We want a gray image on which we can plot colored lines
-	Mat img_plot ;
-	cvtColor(src, img_plot, COLOR_BGR2GRAY) ;
-	cvtColor(img_plot, img_plot, COLOR_GRAY2BGR) ;
-
 	//NEW FROM HERE
 	// std::vector<Vec4i> left_lines, right_lines, top_lines, bottom_lines ;
 	
@@ -294,9 +637,16 @@ Mat process_image(Mat src, std::string src_file_base) {
 	//Get canny edges for each channel, 
 	//combine them, and create a dense block mask which can be applied to all channels.
 	//Save the canny images for another pass to detect lines on each of them
+	//The gray channel is used for line detection, so keep its gradients as the orientation map
+	Mat img_gray_dx, img_gray_dy ;
+
 	for(auto img: imgs) {
 		Mat img_edges;
-		Canny(img, img_edges, 20, 60) ; //based on calibration 
+		if(channel_images_edges.empty()) {
+			detect_edges_oriented(img, img_edges, img_gray_dx, img_gray_dy, 20, 60) ; //based on calibration 
+		} else {
+			Canny(img, img_edges, 20, 60) ;
+		}
 		// Canny(img, img_edges, 30, 250) ; //30, 250
 		channel_images_edges.push_back(img_edges) ;
 	}
@@ -310,7 +660,7 @@ Mat process_image(Mat src, std::string src_file_base) {
 
 	bitwise_not(img_dense_combined, img_dense_combined) ;
 
-	// feedback_image_of["Dense Block Mask"] = img_dense_combined ;
+	debug_sink().add("dense", [img_dense_combined]() { return img_dense_combined ; }) ;
 
 	//We use multiple channels to get the denseblock mask,
 	//but use only the gray channel to detect lines 
@@ -327,57 +677,59 @@ Mat process_image(Mat src, std::string src_file_base) {
 	int i = 0 ;
 	
 	for(auto img : channel_images_edges) {
+		//place the dense mask over the edges image to erase the dense parts.
+		//The line detection applies the mask itself, so this image is only for feedback
 		Mat img_edges_masked ;
-		
-		//place the dense mask over the edges image to erase the dense parts
-		img.copyTo(img_edges_masked, img_dense_combined) ;
-		if(img_edges_masked.empty()) {
-			img_edges_masked = img.clone() ;
+		if(cmdopt_verbose || is_feedback) {
+			img.copyTo(img_edges_masked, img_dense_combined) ;
+			if(img_edges_masked.empty()) {
+				img_edges_masked = img.clone() ;
+			}
 		}
 
-		std::vector<Vec4i> lines, horizontal_lines, vertical_lines ;
+		//split the edge pixels outside the dense areas by orientation into coordinate lists, dropping diagonals,
+		//and detect only near-orthogonal lines on each list
+		std::vector<Point> points_horizontal, points_vertical ;
+		split_edge_points(img, img_gray_dx, img_gray_dy, points_horizontal, points_vertical, img_dense_combined) ;
 
-		detect_lines(img_edges_masked, lines, 0) ;	//aready removes diagonals
-
-		std::copy_if(lines.begin(), lines.end(), std::back_inserter(horizontal_lines), [](Vec4i lin){
-			return std::abs(lin[0] - lin[2]) > std::abs(lin[1] - lin[3]) ;
-		}) ;
+		std::vector<ortho_line> horizontal_plines, vertical_plines ;
 
-		std::copy_if(lines.begin(), lines.end(), std::back_inserter(vertical_lines), [](Vec4i lin){
-			return std::abs(lin[0] - lin[2]) < std::abs(lin[1] - lin[3]) ;
-		}) ;
+		detect_ortho_lines(img.size(), points_horizontal, points_vertical, horizontal_plines, vertical_plines) ;
 
 		if(cmdopt_verbose) {
-			std::cout << "Horizontal: " << horizontal_lines.size() << std::endl ;
-			std::cout << "Vertical: " << vertical_lines.size() << std::endl ;
+			std::cout << "Edge points H:" << points_horizontal.size() << ", V:" << points_vertical.size() 
+				<< " of " << countNonZero(img_edges_masked) << std::endl ;
+			std::cout << "Horizontal: " << horizontal_plines.size() << std::endl ;
+			std::cout << "Vertical: " << vertical_plines.size() << std::endl ;
 		}
-		
-		//build vectors of perspective_lines, so we can merge and detect off-kilter lines
-		std::vector<ortho_line> horizontal_plines, vertical_plines ;
-		
-		for(auto lin : horizontal_lines) { horizontal_plines.push_back(ortho_line(lin)) ; }
-		for(auto lin : vertical_lines) { vertical_plines.push_back(ortho_line(lin)) ; }
-		// fill_perspective_lines(horizontal_plines, horizontal_lines) ;
-		// fill_perspective_lines(vertical_plines, vertical_lines) ;
+
+		debug_sink().add("edges", [img, img_dense_combined, horizontal_plines, vertical_plines]() {
+			Mat img_debug ;
+			img.copyTo(img_debug, img_dense_combined) ;
+			cvtColor(img_debug, img_debug, COLOR_GRAY2BGR) ;
+			draw_debug_lines(img_debug, horizontal_plines, Scalar(0, 255, 255)) ;
+			draw_debug_lines(img_debug, vertical_plines, Scalar(0, 255, 255)) ;
+			return img_debug ;
+		}) ;
 
 		//accumulate the plines from this channel image
 		plines_combined_horizontal.insert(plines_combined_horizontal.end(), horizontal_plines.begin(), horizontal_plines.end()) ;
 		plines_combined_vertical.insert(plines_combined_vertical.end(), vertical_plines.begin(), vertical_plines.end()) ;
 
-		cvtColor(img, img, COLOR_GRAY2BGR) ;
-	
-		//the edge image for this channel
-		cvtColor(img_edges_masked, img_edges_masked, COLOR_GRAY2BGR) ;
-
 		#ifdef USE_GUI
-		plot_lines(img_edges_masked, horizontal_plines, YELLOW) ;
-		plot_lines(img_edges_masked, vertical_plines, YELLOW) ;
+		if(is_feedback) {
+			//the edge image for this channel
+			cvtColor(img_edges_masked, img_edges_masked, COLOR_GRAY2BGR) ;
+
+			plot_lines(img_edges_masked, horizontal_plines, YELLOW) ;
+			plot_lines(img_edges_masked, vertical_plines, YELLOW) ;
 
-		// annotate_plines(img_edges_masked, horizontal_plines, Scalar(255, 255, 127)) ;
-		// annotate_plines(img_edges_masked, vertical_plines, Scalar(127, 255, 255)) ;
+			// annotate_plines(img_edges_masked, horizontal_plines, Scalar(255, 255, 127)) ;
+			// annotate_plines(img_edges_masked, vertical_plines, Scalar(127, 255, 255)) ;
 
-		std::string label_edges = "Edges " + std::string(channel_img_names[i]) + " " + src_file_base ;
-		imshow(label_edges , scale_for_display(img_edges_masked)) ;
+			std::string label_edges = "Edges " + std::string(channel_img_names[i]) + " " + src_file_base ;
+			imshow(label_edges , scale_for_display(img_edges_masked)) ;
+		}
 		#endif
 
 		i++ ;
@@ -385,7 +737,7 @@ Mat process_image(Mat src, std::string src_file_base) {
 
 
 	#ifdef USE_GUI
-	if(!cmdopt_batch) {
+	if(is_feedback) {
 		cvtColor(img_dense_combined, img_dense_combined, COLOR_GRAY2BGR) ;
 		plot_lines(img_dense_combined, plines_combined_horizontal, MAGENTA) ;
 		plot_lines(img_dense_combined, plines_combined_vertical, MAGENTA) ;
@@ -400,14 +752,13 @@ Mat process_image(Mat src, std::string src_file_base) {
 	if((plines_combined_horizontal.size() < 2) || (plines_combined_vertical.size() < 2)) {
 		std::cerr << "BAILING: Too few horiz and vert lines before merge and converge" << std::endl ;
 		#ifdef USE_GUI
-		std::string label = "◆ ☠ Original: " + src_file_base ;
-		imshow(label , scale_for_display(src)) ;
-
-		if(!cmdopt_batch) {
+		if(is_feedback) {
+			std::string label = "◆ ☠ Original: " + src_file_base ;
+			imshow(label , scale_for_display(src)) ;
 			waitKey() ;
 		}
 		#endif
-		return Mat() ;
+		return std::vector<Vec4i>() ;
 	}
 
 
@@ -438,6 +789,13 @@ Mat process_image(Mat src, std::string src_file_base) {
 
 	auto merged_vertical_plines = merged_vertical_plines_angle ;
 
+	debug_sink().add("merged", [img_gray, merged_horizontal_plines, merged_vertical_plines]() {
+		Mat img_debug = Mat::zeros(img_gray.size(), CV_8UC3) ;
+		draw_debug_lines(img_debug, merged_horizontal_plines, Scalar(255, 255, 0)) ;
+		draw_debug_lines(img_debug, merged_vertical_plines, Scalar(255, 0, 255)) ;
+		return img_debug ;
+	}) ;
+
 	std::cout << "Horiz plines after merged: " << merged_horizontal_plines.size() << std::endl ;
 	std::cout << "Vert plines after merged: " << merged_vertical_plines.size() << std::endl ;
 	
@@ -450,49 +808,46 @@ Mat process_image(Mat src, std::string src_file_base) {
 	if((merged_horizontal_plines.size() < 2) || (merged_vertical_plines.size() < 2)) {
 		std::cout << "BAILING: Too few horiz or vert lines after merge and converge" << std::endl ;
 		#ifdef USE_GUI
-		std::string label = "◆ ☠  Original: " + src_file_base ;
-		imshow(label , scale_for_display(src)) ;
-		if(!cmdopt_batch) {
+		if(is_feedback) {
+			std::string label = "◆ ☠  Original: " + src_file_base ;
+			imshow(label , scale_for_display(src)) ;
 			waitKey() ;
 		}
 		#endif
-		return Mat() ;
+		return std::vector<Vec4i>() ;
 	}
 
-	#ifdef USE_GUI
-	if(!cmdopt_batch) {
-
-	}
-	#endif
-	
 	/* Analyze the vertical strips to see if they might be the edges of the cabinet, 
 	 * and if so, give them priority when selecting the best lines.
 	 * This can also be used to roughly identify machine brands by color, 
 	 * and the location of the display area for drink extraction.
 	 * 
+	 * Until the strips are used for selection, they are only feedback.
 	 */
-	Mat img_strips  ;
-	cvtColor(img_gray, img_strips, COLOR_GRAY2RGB) ;
-	img_strips.setTo(CV_RGB(255,255,255));
+	#ifdef USE_GUI
+	if(is_feedback) {
+		Mat img_strips  ;
+		cvtColor(img_gray, img_strips, COLOR_GRAY2RGB) ;
+		img_strips.setTo(CV_RGB(255,255,255));
 
-	Rect rc_img = Rect(0, 0, img_strips.size().width, img_strips.size().height) ;
+		Rect rc_img = Rect(0, 0, img_strips.size().width, img_strips.size().height) ;
 
-	for(size_t i = 0 ; i < merged_vertical_plines.size() ; i++) {
-		auto lin = merged_vertical_plines.at(i) ;
-		auto s = side_strips(src, lin.line) ;
+		for(size_t i = 0 ; i < merged_vertical_plines.size() ; i++) {
+			auto lin = merged_vertical_plines.at(i) ;
+			auto s = side_strips(src, lin.line) ;
 
-		// imshow(std::to_string(i), s) ;
+			// imshow(std::to_string(i), s) ;
 
-		Rect rc_dest = Rect(Point(lin.origin().x - s.size().width / 2, lin.origin().y), s.size()) ;
-		
-		Rect rc_combined = rc_img & rc_dest ;
-		// s=s(rc_combined).clone() ;
-		// s.copyTo(img_strips(rc_combined));
+			Rect rc_dest = Rect(Point(lin.origin().x - s.size().width / 2, lin.origin().y), s.size()) ;
+			
+			Rect rc_combined = rc_img & rc_dest ;
+			// s=s(rc_combined).clone() ;
+			// s.copyTo(img_strips(rc_combined));
 
-		// plot_lines(img_strips, lin.line, Scalar(127, 0, 255)) ;
+			// plot_lines(img_strips, lin.line, Scalar(127, 0, 255)) ;
+		}
+		imshow("strips", scale_for_display(img_strips)) ;
 	}
-	#ifdef USE_GUI
-	imshow("strips", scale_for_display(img_strips)) ;
 	#endif
 	
 	// waitKey() ;
@@ -505,25 +860,16 @@ Mat process_image(Mat src, std::string src_file_base) {
 	auto best_horizontals = best_horizontal_lines(merged_horizontal_plines, src.rows * 2 / 3) ;
 	auto best_verticals   = best_vertical_lines(merged_vertical_plines, src.cols * 2 / 3) ;
 
-
-	//transform
-	Mat img_transformed = transform_perspective(src, 
-		best_horizontals.first, 
-		best_horizontals.second, 
-		best_verticals.first, 
-		best_verticals.second,
-		cmdopt_clip) ;
-
-	/*
-	std::cout << "Trimming away dense background." << std::endl ;
-	Rect rc_dense_trim = trim_dense_edges(transformed_image) ;
-	transformed_image = transformed_image(rc_dense_trim) ;
-	*/
+	debug_sink().add("bounds", [img_gray, best_horizontals, best_verticals]() {
+		Mat img_debug ;
+		cvtColor(img_gray, img_debug, COLOR_GRAY2BGR) ;
+		draw_debug_lines(img_debug, std::vector<Vec4i> { best_horizontals.first, best_horizontals.second }, Scalar(255, 255, 0)) ;
+		draw_debug_lines(img_debug, std::vector<Vec4i> { best_verticals.first, best_verticals.second }, Scalar(255, 0, 255)) ;
+		return img_debug ;
+	}) ;
 
 	#ifdef USE_GUI
-	if(!cmdopt_batch) {
-		std::string label ;
-		
+	if(is_feedback) {
 		Mat img_merged_lines = Mat::zeros(img_gray.size(), CV_8UC3) ;
 		plot_lines(img_merged_lines, merged_horizontal_plines, CYAN) ;
 		plot_lines(img_merged_lines, merged_vertical_plines, MAGENTA) ;
@@ -549,20 +895,19 @@ Mat process_image(Mat src, std::string src_file_base) {
 		plot_lines(img_gray, best_verticals, MAGENTA) ;
 		imshow("Gray Original with best 4 bounds" , scale_for_display(img_gray)) ;
 
-		label = "👍 Corrected Image: " + src_file_base ;
-		imshow(label, scale_for_display(img_transformed)) ;
-
 		//convert to color so we can draw in color on them
 		cvtColor(img_val, img_val, COLOR_GRAY2BGR) ;
 		cvtColor(img_hue, img_hue, COLOR_GRAY2BGR) ;
-
-		waitKey() ;
 	}
 	#endif
 
-	std::cout << "process_image() : Finished processing: " << src_file_base << std::endl ;
+	std::vector<Vec4i> lines_tblr ;
+	lines_tblr.push_back(best_horizontals.first) ;
+	lines_tblr.push_back(best_horizontals.second) ;
+	lines_tblr.push_back(best_verticals.first) ;
+	lines_tblr.push_back(best_verticals.second) ;
 
-	return img_transformed ;
+	return lines_tblr ;
 }
 
 
@@ -630,6 +975,83 @@ bool copy_exif(std::string src_path, std::string dest_path) {
  * @return Mat 
  */
 Mat transform_perspective(Mat img, Vec4i top_line, Vec4i bottom_line, Vec4i left_line, Vec4i right_line, bool is_clip) {
+	std::vector<Point2f> src_quad_points, dst_rect_points ;
+	Size corrected_image_size ;
+
+	auto hom = perspective_homography(img.size(), top_line, bottom_line, left_line, right_line, 
+		corrected_image_size, src_quad_points, dst_rect_points) ;
+
+	Mat warped_image ;//= img.clone() ;
+	
+	// do perspective transformation
+	//in test mode nothing is written, so a nearest-neighbour preview is enough
+	const int warp_quality = cmdopt_nowrite ? FAST_WARP_NEAREST : FAST_WARP_BILINEAR ;
+
+	auto tick_start = getTickCount() ;
+	fast_warp_perspective(img, warped_image, hom, corrected_image_size, warp_quality, Scalar(255, 0, 255)) ;
+	auto tick_fast = getTickCount() ;
+
+	if(cmdopt_benchmark_warp) {
+		benchmark_warp(img, warped_image, hom, corrected_image_size, warp_quality, 
+			(tick_fast - tick_start) * 1000.0 / getTickFrequency()) ;
+	}
+
+	//clip out the filled outlier background areas
+	if (is_clip) {
+		Rect clip_frame = rect_within_image(img.size(), warped_image.size(), src_quad_points, dst_rect_points) ;
+		return warped_image(clip_frame) ;
+	}
+	
+	return warped_image ;
+}
+
+/**
+ * @brief Warp the image again with warpPerspective(), and report the times and the difference from the fast warp
+ * 
+ * @param img source image
+ * @param warped_fast the result of fast_warp_perspective()
+ * @param hom 
+ * @param corrected_image_size 
+ * @param warp_quality FAST_WARP_NEAREST or FAST_WARP_BILINEAR
+ * @param msec_fast time taken by fast_warp_perspective()
+ */
+void benchmark_warp(Mat img, Mat warped_fast, Mat hom, Size corrected_image_size, int warp_quality, double msec_fast) {
+	const int interpolation = (warp_quality == FAST_WARP_NEAREST) ? INTER_NEAREST : INTER_LINEAR ;
+
+	Mat warped_opencv ;
+	auto tick_start = getTickCount() ;
+	warpPerspective(img, warped_opencv, hom, corrected_image_size, interpolation, BORDER_CONSTANT, Scalar(255, 0, 255)) ;
+	double msec_opencv = (getTickCount() - tick_start) * 1000.0 / getTickFrequency() ;
+
+	Mat diff ;
+	absdiff(warped_fast, warped_opencv, diff) ;
+	diff = diff.reshape(1) ;
+
+	double max_diff = 0 ;
+	minMaxLoc(diff, NULL, &max_diff) ;
+
+	std::cout << "Warp " << corrected_image_size << (interpolation == INTER_NEAREST ? " nearest" : " bilinear") 
+		<< ": fast " << msec_fast << " ms, warpPerspective " << msec_opencv << " ms" << std::endl ;
+	std::cout << "Warp difference: mean " << mean(diff)[0] << ", max " << max_diff 
+		<< ", pixels differing by more than 1: " << countNonZero(diff > 1) << std::endl ;
+}
+
+/**
+ * @brief Calculate the homography which maps the quadrilateral bounded by the four lines onto a rectangle,
+ * along with the size of the image that will hold the whole corrected source image.
+ * 
+ * @param img_size size of the source image
+ * @param top_line 
+ * @param bottom_line 
+ * @param left_line 
+ * @param right_line 
+ * @param corrected_image_size output size of the corrected image
+ * @param src_quad_points output corners of the quadrilateral in the source, clockwise from TL
+ * @param dst_rect_points output corners of the rectangle they are mapped to
+ * @return Mat 3x3 homography, CV_64F
+ */
+Mat perspective_homography(Size img_size, Vec4i top_line, Vec4i bottom_line, Vec4i left_line, Vec4i right_line,
+	Size &corrected_image_size, std::vector<Point2f> &src_quad_points, std::vector<Point2f> &dst_rect_points) {
 	/*
 	  There are many instances when the lines are legitimately horizontal or vertical,
 	  and even sufficiently close to the edges of the frame, but they are within the bounds of
@@ -656,8 +1078,8 @@ Mat transform_perspective(Mat img, Vec4i top_line, Vec4i bottom_line, Vec4i left
 		std::cout << "right_line:" << right_line << std::endl ;
 	}
 	
-	std::vector<Point2f> src_quad_points = line_corners(top_line, bottom_line, left_line, right_line) ;
-	std::vector<Point2f> dst_rect_points;
+	src_quad_points = line_corners(top_line, bottom_line, left_line, right_line) ;
+	dst_rect_points.clear() ;
 	// cv:Rect2f dst_rect ; 
 	// std::vector<Point2f> roi_corners_v(roi_corners.begin(), roi_corners.end()) ;
 	
@@ -695,8 +1117,8 @@ Mat transform_perspective(Mat img, Vec4i top_line, Vec4i bottom_line, Vec4i left
 	//it would be more accurate to take the length along the line instead of the axes. But probably not much difference.
 	auto left_margin = pt_tl.x ;
 	auto top_margin = pt_tl.y ;
-	auto right_margin = img.cols - pt_br.x ;
-	auto bottom_margin = img.rows - pt_br.y ;
+	auto right_margin = img_size.width - pt_br.x ;
+	auto bottom_margin = img_size.height - pt_br.y ;
 	//  bottom_margin = (aspect_ratio * (left_margin + dst_width + right_margin)) - top_margin - dst_height ;
 	/*
 	  Bottom margin should be calculated such that
@@ -763,33 +1185,22 @@ Mat transform_perspective(Mat img, Vec4i top_line, Vec4i bottom_line, Vec4i left
 
 	auto hom = cv::findHomography(src_quad_points, dst_rect_points);
 	
-	auto corrected_image_size =	Size(cvRound(dst_width + left_margin + right_margin), cvRound(dst_height + top_margin + bottom_margin));
-
-	Mat warped_image ;//= img.clone() ;
-	
-	// do perspective transformation
-	warpPerspective(img, warped_image, hom, corrected_image_size, INTER_LINEAR, BORDER_CONSTANT, Scalar(255, 0, 255));
+	corrected_image_size = Size(cvRound(dst_width + left_margin + right_margin), cvRound(dst_height + top_margin + bottom_margin));
 
-	//clip out the filled outlier background areas
-	if (is_clip) {
-		Rect clip_frame = rect_within_image(img, warped_image, src_quad_points, dst_rect_points) ;
-		return warped_image(clip_frame) ;
-	}
-	
-	return warped_image ;
+	return hom ;
 }
 
 /**
  * @brief Calculate the rectangle which would contain only image areas, no filled background
 	This is used to clip out the blank (outside of the image) margins.
  * 
- * @param img Uncorrected source image
- * @param corrected_img 
+ * @param img_size size of the uncorrected source image
+ * @param corrected_size size of the full corrected image
  * @param detected_corners 
  * @param dst_corners 
  * @return Rect 
  */
-Rect rect_within_image(Mat img, Mat corrected_img, std::vector<Point2f> src_quad_pts, std::vector<Point2f> dst_rect_pts) {
+Rect rect_within_image(Size img_size, Size corrected_size, std::vector<Point2f> src_quad_pts, std::vector<Point2f> dst_rect_pts) {
 	// std::vector<Point2f> corners_v(src_quad.begin(), src_quad.end()) ;
 
 	Mat trans = getPerspectiveTransform(src_quad_pts, dst_rect_pts) ;
@@ -797,9 +1208,9 @@ Rect rect_within_image(Mat img, Mat corrected_img, std::vector<Point2f> src_quad
 	std::vector<Point2f> img_frame(4), transformed ;
 
 	img_frame[0] = Point2f(0.0, 0.0) ;
-	img_frame[1] = Point2f(img.cols, 0.0) ;
-	img_frame[2] = Point2f(img.cols, img.rows) ;
-	img_frame[3] = Point2f(0.0, img.rows) ;
+	img_frame[1] = Point2f(img_size.width, 0.0) ;
+	img_frame[2] = Point2f(img_size.width, img_size.height) ;
+	img_frame[3] = Point2f(0.0, img_size.height) ;
 	
 	perspectiveTransform(img_frame, transformed, trans) ;
 
@@ -809,9 +1220,9 @@ Rect rect_within_image(Mat img, Mat corrected_img, std::vector<Point2f> src_quad
 	Point2f clip_bl = transformed[3] ;
 
 	float clip_left   = max<float>(((clip_tl.x > clip_bl.x) ? clip_tl.x : clip_bl.x), 0) ;
-	float clip_right  = min<float>(((clip_tr.x < clip_br.x) ? clip_tr.x : clip_br.x), corrected_img.cols) ;  
+	float clip_right  = min<float>(((clip_tr.x < clip_br.x) ? clip_tr.x : clip_br.x), corrected_size.width) ;  
 	float clip_top    = max<float>(((clip_tl.y > clip_tr.y) ? clip_tl.y : clip_tr.y), 0) ;
-	float clip_bottom = min<float>(((clip_bl.y < clip_br.y) ? clip_bl.y : clip_br.y), corrected_img.rows) ;
+	float clip_bottom = min<float>(((clip_bl.y < clip_br.y) ? clip_bl.y : clip_br.y), corrected_size.height) ;
 
 	Rect clip_frame = Rect(Point(clip_left, clip_top), Point(clip_right, clip_bottom)) ;
 
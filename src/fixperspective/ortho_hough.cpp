@@ -0,0 +1,401 @@
+/**
+ * @file ortho_hough.cpp
+ * @brief A Hough transform which only accumulates over lines close to horizontal or vertical.
+ *
+ * HoughLinesP() votes over the full 180 degrees, and detect_lines() then throws away everything
+ * that is more than about 10 degrees off. Here each orientation family gets its own narrow accumulator.
+ *
+ * Both families are handled by the same code by working in (u, v) coordinates,
+ * where u runs along the lines of the family and v across them:
+ *   horizontal: u = x, v = y
+ *   vertical:   u = y, v = x
+ * A line is then v * cos(phi) - u * sin(phi) = rho, with phi within ORTHO_HOUGH_MAX_ANGLE of 0.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgproc.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#endif
+
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstdlib>
+
+using namespace cv ;
+
+#include "../lines.hpp"
+#include "ortho_hough.hpp"
+
+extern bool cmdopt_verbose ;
+
+/**
+ * @brief Accumulator for one orientation family
+ */
+struct ortho_accumulator {
+	bool is_horizontal ;
+	int len_u, len_v ;	//extent of the image along and across the lines
+	int num_theta ;
+	int rho_offset ;	//added to rho to get its index in the accumulator
+	int num_rho ;
+	std::vector<float> cos_t, sin_t ;
+	std::vector<int> votes ;	//num_theta rows of num_rho
+
+	ortho_accumulator(bool is_horiz, Size img_size, int max_angle) ;
+
+	inline int rho_index(int t, int u, int v) const {
+		return cvRound(v * cos_t[t] - u * sin_t[t]) + rho_offset ;
+	}
+
+	inline void vote(int u, int v) {
+		for(int t = 0 ; t < num_theta ; t++) {
+			votes[t * num_rho + rho_index(t, u, v)]++ ;
+		}
+	}
+
+	Vec4i segment(int t, int rho_idx, int u_start, int u_end) const ;
+} ;
+
+ortho_accumulator::ortho_accumulator(bool is_horiz, Size img_size, int max_angle)
+	: is_horizontal(is_horiz)
+{
+	len_u = is_horizontal ? img_size.width : img_size.height ;
+	len_v = is_horizontal ? img_size.height : img_size.width ;
+
+	//one degree per bin, the same as detect_lines()
+	num_theta = 2 * max_angle + 1 ;
+
+	for(int t = 0 ; t < num_theta ; t++) {
+		double phi = (t - max_angle) * CV_PI / 180 ;
+		cos_t.push_back(cos(phi)) ;
+		sin_t.push_back(sin(phi)) ;
+	}
+
+	rho_offset = cvCeil(len_u * sin(max_angle * CV_PI / 180)) + 1 ;
+	num_rho = len_v + 2 * rho_offset + 1 ;
+
+	votes.assign(num_theta * num_rho, 0) ;
+}
+
+/**
+ * @brief The line segment on the line (t, rho_idx) from u_start to u_end, in image (x, y) coordinates
+ */
+Vec4i ortho_accumulator::segment(int t, int rho_idx, int u_start, int u_end) const {
+	const float rho = rho_idx - rho_offset ;
+	int v_start = cvRound((rho + u_start * sin_t[t]) / cos_t[t]) ;
+	int v_end   = cvRound((rho + u_end * sin_t[t]) / cos_t[t]) ;
+
+	if(is_horizontal) {
+		return Vec4i(u_start, v_start, u_end, v_end) ;
+	} else {
+		return Vec4i(v_start, u_start, v_end, u_end) ;
+	}
+}
+
+/**
+ * @brief Compact lookup of the edge points of one family, bucketed by v and sorted by u within each bucket
+ */
+struct edge_point_index {
+	std::vector<int> offsets ;	//start of each v bucket in us, len_v + 1 entries
+	std::vector<int> us ;
+
+	edge_point_index(const std::vector<Point> &points, bool is_horizontal, int len_v) ;
+
+	inline bool contains(int u, int v) const {
+		if(v < 0 || v + 1 >= (int)offsets.size()) { return false ; }
+		return std::binary_search(us.begin() + offsets[v], us.begin() + offsets[v + 1], u) ;
+	}
+} ;
+
+edge_point_index::edge_point_index(const std::vector<Point> &points, bool is_horizontal, int len_v)
+	: offsets(len_v + 1, 0), us(points.size())
+{
+	//counting sort on v
+	for(const auto &pt : points) { offsets[(is_horizontal ? pt.y : pt.x) + 1]++ ; }
+	for(int v = 0 ; v < len_v ; v++) { offsets[v + 1] += offsets[v] ; }
+
+	std::vector<int> fill_pos(offsets.begin(), offsets.end() - 1) ;
+	for(const auto &pt : points) {
+		if(is_horizontal) {
+			us[fill_pos[pt.y]++] = pt.x ;
+		} else {
+			us[fill_pos[pt.x]++] = pt.y ;
+		}
+	}
+
+	for(int v = 0 ; v < len_v ; v++) {
+		std::sort(us.begin() + offsets[v], us.begin() + offsets[v + 1]) ;
+	}
+}
+
+/**
+ * @brief Walk along the line of an accumulator peak, and collect the runs of edge points
+ * which are long enough, allowing for small gaps.
+ */
+static void trace_segments(const ortho_accumulator &acc, const edge_point_index &index, Point peak,
+	int min_length, int max_gap, std::vector<Vec4i> &segments) {
+	const int t = peak.x ;
+	const float rho = peak.y - acc.rho_offset ;
+
+	int run_start = -1 ;
+	int last_hit = -1 ;
+
+	for(int u = 0 ; u <= acc.len_u ; u++) {
+		bool is_hit = false ;
+
+		if(u < acc.len_u) {
+			int v = cvRound((rho + u * acc.sin_t[t]) / acc.cos_t[t]) ;
+			//allow one pixel either side, since the edges are not perfectly straight
+			is_hit = index.contains(u, v) || index.contains(u, v - 1) || index.contains(u, v + 1) ;
+		}
+
+		if(is_hit) {
+			if(run_start < 0) { run_start = u ; }
+			last_hit = u ;
+		} else if(run_start >= 0 && (u - last_hit > max_gap || u == acc.len_u)) {
+			if(last_hit - run_start >= min_length) {
+				segments.push_back(acc.segment(t, peak.y, run_start, last_hit)) ;
+			}
+			run_start = -1 ;
+		}
+	}
+}
+
+/**
+ * @brief Find the local maxima in the accumulator, and trace the line segments along each of them
+ */
+static void extract_family_lines(const ortho_accumulator &acc, const std::vector<Point> &points,
+	int vote_threshold, int min_length, int max_gap, std::vector<ortho_line> &plines) {
+	//neighbourhood for non-maximum suppression, in theta bins and rho bins
+	const int NMS_THETA = 1 ;
+	const int NMS_RHO = 2 ;
+
+	std::vector<Point> peaks ;	//(theta index, rho index)
+
+	for(int t = 0 ; t < acc.num_theta ; t++) {
+		for(int r = 0 ; r < acc.num_rho ; r++) {
+			const int val = acc.votes[t * acc.num_rho + r] ;
+			if(val < vote_threshold) { continue ; }
+
+			bool is_peak = true ;
+			for(int dt = -NMS_THETA ; dt <= NMS_THETA && is_peak ; dt++) {
+				for(int dr = -NMS_RHO ; dr <= NMS_RHO ; dr++) {
+					int nt = t + dt ;
+					int nr = r + dr ;
+					if(nt < 0 || nt >= acc.num_theta || nr < 0 || nr >= acc.num_rho) { continue ; }
+					if(dt == 0 && dr == 0) { continue ; }
+
+					const int nval = acc.votes[nt * acc.num_rho + nr] ;
+					//ties go to the first one in raster order
+					bool is_before = (dt < 0) || (dt == 0 && dr < 0) ;
+					if(nval > val || (nval == val && is_before)) {
+						is_peak = false ;
+						break ;
+					}
+				}
+			}
+
+			if(is_peak) {
+				peaks.push_back(Point(t, r)) ;
+			}
+		}
+	}
+
+	if(peaks.empty()) {
+		return ;
+	}
+
+	edge_point_index index(points, acc.is_horizontal, acc.len_v) ;
+
+	std::vector<std::vector<Vec4i> > peak_segments(peaks.size()) ;
+
+	parallel_for_(Range(0, (int)peaks.size()), [&](const Range &range) {
+		for(int i = range.start ; i < range.end ; i++) {
+			trace_segments(acc, index, peaks[i], min_length, max_gap, peak_segments[i]) ;
+		}
+	}) ;
+
+	for(const auto &segments : peak_segments) {
+		for(const auto &lin : segments) {
+			//the accumulator reaches a little further than detect_lines() did
+			if(slant(lin) > 0.1) { continue ; }
+			plines.push_back(ortho_line(lin)) ;
+		}
+	}
+}
+
+/**
+ * @brief Split the edge pixels into two lists of coordinates, those on mostly horizontal edges
+ * and those on mostly vertical edges, using the gradient direction at each pixel.
+ * Pixels whose gradient is too far from either axis are on diagonal edges, such as the
+ * lettering on drink labels, and are dropped.
+ * The image is scanned in horizontal strips in parallel. Each list is in raster order.
+ *
+ * @param img_edges Canny edge image, CV_8UC1
+ * @param img_dx horizontal gradient (Sobel, CV_16SC1) of the image the edges were detected on
+ * @param img_dy vertical gradient (Sobel, CV_16SC1)
+ * @param points_horizontal output points on horizontal edges, in image coordinates
+ * @param points_vertical output points on vertical edges, in image coordinates
+ * @param mask optional CV_8UC1 mask, edge pixels where it is zero are skipped
+ */
+void split_edge_points(Mat img_edges, Mat img_dx, Mat img_dy,
+	std::vector<Point> &points_horizontal, std::vector<Point> &points_vertical, Mat mask) {
+	CV_Assert(img_edges.type() == CV_8UC1) ;
+	CV_Assert(img_dx.type() == CV_16SC1 && img_dy.type() == CV_16SC1) ;
+	CV_Assert(img_dx.size() == img_edges.size() && img_dy.size() == img_edges.size()) ;
+
+	const bool is_masked = !mask.empty() ;
+	if(is_masked) {
+		CV_Assert(mask.type() == CV_8UC1 && mask.size() == img_edges.size()) ;
+	}
+
+	//compare in integers: |minor| * 1000 <= |major| * skew * 1000
+	const int skew_permille = cvRound(ORTHO_EDGE_MAX_SKEW * 1000) ;
+
+	const int num_strips = std::max(1, std::min(img_edges.rows / 64, getNumberOfCPUs())) ;
+
+	std::vector<std::vector<Point> > strip_points_h(num_strips), strip_points_v(num_strips) ;
+
+	parallel_for_(Range(0, num_strips), [&](const Range &range) {
+		for(int s = range.start ; s < range.end ; s++) {
+			const int row_begin = img_edges.rows * s / num_strips ;
+			const int row_end   = img_edges.rows * (s + 1) / num_strips ;
+
+			for(int y = row_begin ; y < row_end ; y++) {
+				const uchar *edge_row = img_edges.ptr<uchar>(y) ;
+				const uchar *mask_row = is_masked ? mask.ptr<uchar>(y) : 0 ;
+				const short *dx_row = img_dx.ptr<short>(y) ;
+				const short *dy_row = img_dy.ptr<short>(y) ;
+
+				for(int x = 0 ; x < img_edges.cols ; x++) {
+					if(!edge_row[x] || (is_masked && !mask_row[x])) { continue ; }
+
+					//the gradient runs across the edge, so a mostly vertical gradient is on a horizontal line
+					const int adx = std::abs(dx_row[x]) ;
+					const int ady = std::abs(dy_row[x]) ;
+
+					if(adx * 1000 <= ady * skew_permille) {
+						strip_points_h[s].push_back(Point(x, y)) ;
+					} else if(ady * 1000 <= adx * skew_permille) {
+						strip_points_v[s].push_back(Point(x, y)) ;
+					}
+				}
+			}
+		}
+	}, num_strips) ;
+
+	points_horizontal.clear() ;
+	points_vertical.clear() ;
+
+	for(int s = 0 ; s < num_strips ; s++) {
+		points_horizontal.insert(points_horizontal.end(), strip_points_h[s].begin(), strip_points_h[s].end()) ;
+		points_vertical.insert(points_vertical.end(), strip_points_v[s].begin(), strip_points_v[s].end()) ;
+	}
+}
+
+/**
+ * @brief Detect lines close to horizontal and vertical from lists of edge points,
+ * one list for each orientation.
+ * Both families are voted in parallel, each list being divided into chunks with their own accumulators.
+ *
+ * @param img_size size of the image the points were taken from
+ * @param points_horizontal points on horizontal edges, in image coordinates
+ * @param points_vertical points on vertical edges, in image coordinates
+ * @param horizontal_plines output horizontal lines
+ * @param vertical_plines output vertical lines
+ * @param threshold minimum votes for a line, in addition to the minimum from the line length
+ */
+void detect_ortho_lines(Size img_size, const std::vector<Point> &points_horizontal, const std::vector<Point> &points_vertical,
+	std::vector<ortho_line> &horizontal_plines, std::vector<ortho_line> &vertical_plines, int threshold) {
+	//same limits as detect_lines()
+	bool is_image_portrait = img_size.height > img_size.width ;
+
+	const int min_vertical_length = img_size.height / 3 ;
+	const int min_horizontal_length = img_size.width / 3 ;
+
+	const int min_line_length = is_image_portrait ? min_horizontal_length : min_vertical_length ;
+	const int max_gap = min_line_length / 10 ;
+
+	//a line must be at least half covered by edge points to be worth tracing
+	const int vote_threshold = std::max(threshold, min_line_length / 2) ;
+
+	const ortho_accumulator acc_horizontal(true, img_size, ORTHO_HOUGH_MAX_ANGLE) ;
+	const ortho_accumulator acc_vertical(false, img_size, ORTHO_HOUGH_MAX_ANGLE) ;
+
+	//tasks [0, num_chunks) vote horizontals, [num_chunks, 2 * num_chunks) vote verticals
+	const int num_chunks = std::max(1, getNumberOfCPUs() / 2) ;
+
+	std::vector<ortho_accumulator> chunk_acc_h(num_chunks, acc_horizontal) ;
+	std::vector<ortho_accumulator> chunk_acc_v(num_chunks, acc_vertical) ;
+
+	parallel_for_(Range(0, 2 * num_chunks), [&](const Range &range) {
+		for(int task = range.start ; task < range.end ; task++) {
+			const bool is_horizontal = task < num_chunks ;
+			const int c = is_horizontal ? task : task - num_chunks ;
+			const std::vector<Point> &points = is_horizontal ? points_horizontal : points_vertical ;
+			ortho_accumulator &acc = is_horizontal ? chunk_acc_h[c] : chunk_acc_v[c] ;
+
+			const size_t begin = points.size() * c / num_chunks ;
+			const size_t end   = points.size() * (c + 1) / num_chunks ;
+
+			for(size_t i = begin ; i < end ; i++) {
+				if(is_horizontal) {
+					acc.vote(points[i].x, points[i].y) ;
+				} else {
+					acc.vote(points[i].y, points[i].x) ;
+				}
+			}
+		}
+	}, 2 * num_chunks) ;
+
+	//combine the chunks
+	for(int c = 1 ; c < num_chunks ; c++) {
+		std::transform(chunk_acc_h[0].votes.begin(), chunk_acc_h[0].votes.end(), chunk_acc_h[c].votes.begin(),
+			chunk_acc_h[0].votes.begin(), std::plus<int>()) ;
+		std::transform(chunk_acc_v[0].votes.begin(), chunk_acc_v[0].votes.end(), chunk_acc_v[c].votes.begin(),
+			chunk_acc_v[0].votes.begin(), std::plus<int>()) ;
+	}
+
+	extract_family_lines(chunk_acc_h[0], points_horizontal, vote_threshold, min_line_length, max_gap, horizontal_plines) ;
+	extract_family_lines(chunk_acc_v[0], points_vertical, vote_threshold, min_line_length, max_gap, vertical_plines) ;
+}
+
+/**
+ * @brief Detect lines close to horizontal and vertical on a Canny edge image.
+ * If the gradient images are given, the edge pixels are split by orientation with split_edge_points(),
+ * otherwise every edge pixel votes for both families.
+ *
+ * @param img_edges Canny edge image, CV_8UC1
+ * @param horizontal_plines output horizontal lines
+ * @param vertical_plines output vertical lines
+ * @param threshold minimum votes for a line, in addition to the minimum from the line length
+ * @param img_dx horizontal gradient (Sobel, CV_16SC1) of the image the edges were detected on, optional
+ * @param img_dy vertical gradient (Sobel, CV_16SC1), optional
+ */
+void detect_ortho_lines(Mat img_edges, std::vector<ortho_line> &horizontal_plines, std::vector<ortho_line> &vertical_plines,
+	int threshold, Mat img_dx, Mat img_dy) {
+	CV_Assert(img_edges.type() == CV_8UC1) ;
+
+	std::vector<Point> points_h, points_v ;
+
+	if(!img_dx.empty() && !img_dy.empty()) {
+		split_edge_points(img_edges, img_dx, img_dy, points_h, points_v) ;
+	} else {
+		findNonZero(img_edges, points_h) ;
+		points_v = points_h ;
+	}
+
+	if(cmdopt_verbose) {
+		std::cout << "Ortho Hough edge points H:" << points_h.size() << ", V:" << points_v.size() << std::endl ;
+	}
+
+	detect_ortho_lines(img_edges.size(), points_h, points_v, horizontal_plines, vertical_plines, threshold) ;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file ortho_hough.hpp
+ * @brief A Hough transform which only accumulates over lines close to horizontal or vertical.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include "perspective_lines.hpp"
+
+//maximum deviation from horizontal / vertical, in degrees, that is accumulated
+const int ORTHO_HOUGH_MAX_ANGLE = 10 ;
+
+//tangent of the largest angle (about 30 degrees) between an edge pixel's gradient and an axis.
+//Edge pixels further off than that from both axes are taken as diagonal.
+const float ORTHO_EDGE_MAX_SKEW = 0.577f ;
+
+void split_edge_points(cv::Mat img_edges, cv::Mat img_dx, cv::Mat img_dy,
+	std::vector<cv::Point> &points_horizontal, std::vector<cv::Point> &points_vertical, cv::Mat mask = cv::Mat()) ;
+void detect_ortho_lines(cv::Size img_size, const std::vector<cv::Point> &points_horizontal, const std::vector<cv::Point> &points_vertical,
+	std::vector<ortho_line> &horizontal_plines, std::vector<ortho_line> &vertical_plines, int threshold = 0) ;
+void detect_ortho_lines(cv::Mat img_edges, std::vector<ortho_line> &horizontal_plines, std::vector<ortho_line> &vertical_plines,
+	int threshold = 0, cv::Mat img_dx = cv::Mat(), cv::Mat img_dy = cv::Mat()) ;
@@ -0,0 +1,181 @@
+/**
+ * @file track.cpp
+ * @brief Follow the four bounding lines of the cabinet from one video frame to the next
+ * 
+ * Between consecutive frames of a burst the cabinet moves only a little, so instead of running
+ * the whole line detection again, each line from the previous frame is searched for
+ * only within a narrow band around where it was.
+ * 
+ * As in ortho_hough.cpp, a line is handled in (u, v) coordinates, u running along the line and v across it.
+ * 
+ * @version 0.1
+ * @date 2026-10-19
+ * 
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgproc.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#endif
+
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace cv ;
+
+#include "track.hpp"
+
+extern bool cmdopt_verbose ;
+
+//distance in pixels between the samples taken along a line
+const int TRACK_SAMPLE_STEP = 4 ;
+
+//weakest Sobel response across the band that is accepted as the edge
+const int TRACK_MIN_GRADIENT = 40 ;
+
+/**
+ * @brief Search for a line within a band around its previous position, and refit it to the edge found there.
+ * Samples are taken along the line, and at each one the strongest gradient across the line within the band,
+ * favoring those nearer the previous position, is taken as a point on the edge.
+ * The line keeps its extent along its length.
+ * 
+ * @param img_gray the current frame, single channel
+ * @param lin the line in the previous frame, updated to the line in this frame if enough of it is found
+ * @param is_horizontal orientation of the line
+ * @param band search distance either side of the previous line, in pixels
+ * @return float the fraction of samples which found an edge
+ */
+float refine_bounding_line(Mat img_gray, Vec4i &lin, bool is_horizontal, int band) {
+	//endpoints in (u, v)
+	int u0 = is_horizontal ? lin[0] : lin[1] ;
+	int v0 = is_horizontal ? lin[1] : lin[0] ;
+	int u1 = is_horizontal ? lin[2] : lin[3] ;
+	int v1 = is_horizontal ? lin[3] : lin[2] ;
+
+	if(u0 > u1) {
+		std::swap(u0, u1) ;
+		std::swap(v0, v1) ;
+	}
+
+	if(u1 == u0) {
+		return 0 ;
+	}
+
+	//only the part of the image around the line is needed
+	Rect rc_band = is_horizontal ?
+		Rect(Point(u0, std::min(v0, v1) - band), Point(u1 + 1, std::max(v0, v1) + band + 1)) :
+		Rect(Point(std::min(v0, v1) - band, u0), Point(std::max(v0, v1) + band + 1, u1 + 1)) ;
+	rc_band &= Rect(0, 0, img_gray.cols, img_gray.rows) ;
+
+	if(rc_band.empty()) {
+		return 0 ;
+	}
+
+	//gradient across the line
+	Mat img_grad ;
+	if(is_horizontal) {
+		Sobel(img_gray(rc_band), img_grad, CV_16S, 0, 1, 3) ;
+	} else {
+		Sobel(img_gray(rc_band), img_grad, CV_16S, 1, 0, 3) ;
+	}
+
+	const float slope = float(v1 - v0) / (u1 - u0) ;
+
+	std::vector<Point2f> edge_points ;
+	int num_samples = 0 ;
+
+	for(int u = u0 ; u <= u1 ; u += TRACK_SAMPLE_STEP) {
+		const int v_predicted = cvRound(v0 + (u - u0) * slope) ;
+
+		//position in the band image
+		const int bu = u - (is_horizontal ? rc_band.x : rc_band.y) ;
+		const int bv_origin = is_horizontal ? rc_band.y : rc_band.x ;
+		const int len_u = is_horizontal ? img_grad.cols : img_grad.rows ;
+		const int len_v = is_horizontal ? img_grad.rows : img_grad.cols ;
+
+		if(bu < 0 || bu >= len_u) { continue ; }
+		num_samples++ ;
+
+		float best_score = 0 ;
+		int best_v = -1 ;
+
+		for(int dv = -band ; dv <= band ; dv++) {
+			const int bv = v_predicted + dv - bv_origin ;
+			if(bv < 0 || bv >= len_v) { continue ; }
+
+			const int g = std::abs(is_horizontal ? img_grad.at<short>(bv, bu) : img_grad.at<short>(bu, bv)) ;
+			if(g < TRACK_MIN_GRADIENT) { continue ; }
+
+			const float score = g * (1.0f - 0.5f * std::abs(dv) / (band + 1)) ;
+			if(score > best_score) {
+				best_score = score ;
+				best_v = v_predicted + dv ;
+			}
+		}
+
+		if(best_v >= 0) {
+			edge_points.push_back(is_horizontal ? Point2f(u, best_v) : Point2f(best_v, u)) ;
+		}
+	}
+
+	if(num_samples == 0) {
+		return 0 ;
+	}
+
+	const float confidence = float(edge_points.size()) / num_samples ;
+
+	if(confidence < TRACK_MIN_CONFIDENCE || edge_points.size() < 2) {
+		return confidence ;
+	}
+
+	//robust fit, so that a few samples caught on labels or reflections do not pull the line
+	Vec4f fit ;	//vx, vy, x0, y0
+	fitLine(edge_points, fit, DIST_HUBER, 0, 0.01, 0.01) ;
+
+	const float fu = is_horizontal ? fit[0] : fit[1] ;
+	const float fv = is_horizontal ? fit[1] : fit[0] ;
+	const float pu = is_horizontal ? fit[2] : fit[3] ;
+	const float pv = is_horizontal ? fit[3] : fit[2] ;
+
+	if(std::abs(fu) < 1e-6) {
+		return 0 ;
+	}
+
+	const int nv0 = cvRound(pv + (u0 - pu) * fv / fu) ;
+	const int nv1 = cvRound(pv + (u1 - pu) * fv / fu) ;
+
+	lin = is_horizontal ? Vec4i(u0, nv0, u1, nv1) : Vec4i(nv0, u0, nv1, u1) ;
+
+	return confidence ;
+}
+
+/**
+ * @brief Refine all four bounding lines on a new frame.
+ * 
+ * @param img_gray the current frame, single channel
+ * @param lines_tblr top, bottom, left, right lines from the previous frame, updated in place
+ * @param band search distance either side of each line, in pixels
+ * @return float the lowest confidence of the four lines
+ */
+float track_bounding_lines(Mat img_gray, std::vector<Vec4i> &lines_tblr, int band) {
+	CV_Assert(lines_tblr.size() == 4) ;
+
+	float confidences[4] ;
+
+	parallel_for_(Range(0, 4), [&](const Range &range) {
+		for(int i = range.start ; i < range.end ; i++) {
+			confidences[i] = refine_bounding_line(img_gray, lines_tblr[i], i < 2, band) ;
+		}
+	}) ;
+
+	if(cmdopt_verbose) {
+		std::cout << "Tracking confidence T:" << confidences[0] << " B:" << confidences[1] 
+			<< " L:" << confidences[2] << " R:" << confidences[3] << std::endl ;
+	}
+
+	return *std::min_element(confidences, confidences + 4) ;
+}
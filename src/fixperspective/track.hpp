@@ -0,0 +1,15 @@
+/**
+ * @file track.hpp
+ * @brief Follow the four bounding lines of the cabinet from one video frame to the next
+ * @version 0.1
+ * @date 2026-10-19
+ * 
+ */
+
+#pragma once
+
+//below this fraction of samples finding an edge, a line is considered lost
+const float TRACK_MIN_CONFIDENCE = 0.5f ;
+
+float refine_bounding_line(cv::Mat img_gray, cv::Vec4i &lin, bool is_horizontal, int band) ;
+float track_bounding_lines(cv::Mat img_gray, std::vector<cv::Vec4i> &lines_tblr, int band) ;
@@ -15,18 +15,26 @@ generate_histogram.cpp
 using namespace cv ;
 
 #include <iostream>
+#include <fstream>
+#include <map>
 #include <unistd.h>
 #include <libgen.h>	//basename
 
 #include "histogram.hpp"
+#include "feature_extractor.hpp"
 
-int process_file(std::string filepath) ;
+bool compute_model(const std::string &filepath, struct model_data &model) ;
+int write_model(const struct model_data &model) ;
+int write_models_to_bundle(const std::vector<std::string> &filepaths, std::vector<struct model_data> &models,
+	const std::vector<uchar> &is_computed, const std::string &bundle_path) ;
 std::pair<std::string, int> parse_model_image_filename(std::string path) ;
 std::string outfile_name(const struct model_data model) ;
 
 // static bool cmdopt_generate_histograms = false;
 bool cmdopt_verbose = false ;
+bool cmdopt_retain = false ;
 std::string dest_dir = "";
+std::vector<std::string> feature_names ;	//extractors to store besides the H-S histograms
 // static bool cmdopt_best = false ;
 // bool cmdopt_yaml = false ;q
 // bool cmdopt_target_name = false ;
@@ -34,8 +42,13 @@ std::string dest_dir = "";
 void help() {
 	std::cout << "generate_histogram" << std::endl ;
 	std::cout << "  -d dir : output directory" << std::endl ;
-	std::cout << "  -o file : output file" << std::endl ;
-	// std::cout << "  -r : retain name and volume from existing file" << std::endl ;
+	std::cout << "  -f names : also store these features, comma-separated:" ;
+	for(const auto &name : feature_extractor_names()) {
+		std::cout << " " << name ;
+	}
+	std::cout << std::endl ;
+	std::cout << "  -o file : merge the models into one binary file, instead of writing a YAML file each" << std::endl ;
+	std::cout << "  -r : retain name and volume from existing file" << std::endl ;
 	std::cout << "  -v : verbose" << std::endl ;
 }
 
@@ -50,15 +63,24 @@ int main(int argc, char *argv[]) {
    	char *cvalue = NULL ;
    	char c ;
 
-    while((c = getopt(argc, argv, "d:hv")) != -1) {
+    while((c = getopt(argc, argv, "d:f:ho:rv")) != -1) {
 		switch(c) {
 			case 'd':
 				cvalue = optarg ;
 				dest_dir = cvalue ;
 				break ;
+			case 'f':
+				feature_names = parse_feature_names(optarg) ;
+				break ;
 			case 'h':
 				help() ;
 				exit(0) ;
+			case 'o':
+				dest_file = optarg ;
+				break ;
+			case 'r':
+				cmdopt_retain = true ;
+				break ;
 			case 'v':
 				cmdopt_verbose = true ;
 				break ;
@@ -70,44 +92,67 @@ int main(int argc, char *argv[]) {
 		exit(-1) ;
 	}
 
-    for(int i = optind ; i < argc ; i++) {
-		std::string argstr = argv[i] ;
-        process_file(argstr) ;
+	//decode and histogram all the files in parallel, then write them in order
+	std::vector<std::string> filepaths(argv + optind, argv + argc) ;
+	std::vector<struct model_data> models(filepaths.size()) ;
+	std::vector<uchar> is_computed(filepaths.size(), 0) ;
+
+	parallel_for_(Range(0, filepaths.size()), [&](const Range &range) {
+		for(int i = range.start ; i < range.end ; i++) {
+			is_computed[i] = compute_model(filepaths[i], models[i]) ;
+		}
+	}) ;
+
+	if(!dest_file.empty()) {
+		return write_models_to_bundle(filepaths, models, is_computed, dest_file) ;
+	}
+
+    for(size_t i = 0 ; i < filepaths.size() ; i++) {
+		if(!is_computed[i]) {
+			std::cerr << "The file is empty: " << filepaths[i] << std::endl ;
+			continue ;
+		}
+        write_model(models[i]) ;
     }
 
     return 0 ;
 }
 
-int process_file(std::string filepath) {
+/**
+ * Decode a model image and generate its histograms. Safe to call from several threads.
+ * */
+bool compute_model(const std::string &filepath, struct model_data &model) {
     Mat src ;
 	src = imread(filepath, 1) ; 
 
 	if(src.empty()) {
-		std::cerr << "The file is empty: " << filepath << std::endl ;
+		return false ;
 	}
 
-	std::vector<Mat> hist_set ;
-
 	try{
-		hist_set = generate_histogram_set(src, 10, 12) ;
+		extract_model_features(src, model, feature_names) ;
 	} catch (cv::Exception &e) {
 		std::cout << "In the exception catch" << std::endl ;
 		std::cout << e.msg << std::endl ;
 		throw e ;
 	}
 
-	struct model_data model ;
-
 	auto name_and_volume = parse_model_image_filename(filepath) ;
 
 	model.drink_name   = name_and_volume.first ;
 	model.drink_volume = name_and_volume.second ;
-	model.histograms   = hist_set ;
 
 	char *c_filepath = strdup(filepath.c_str()) ;
 	model.source_image_path = basename(c_filepath) ;
 	free(c_filepath) ;
 
+	return true ;
+}
+
+/**
+ * Write the YAML histogram file of a model
+ * */
+int write_model(const struct model_data &model) {
 	/*
 	std::string dest_path = outfile_name(model) ;
 	return -1; 
@@ -126,7 +171,7 @@ int process_file(std::string filepath) {
 	if(cmdopt_verbose) {
 		std::cout << "Output file: " << dest_path << std::endl ;
 	}
-	write_yaml_histogram(model, dest_path) ;
+	write_yaml_histogram(model, dest_path, cmdopt_retain) ;
 
 	/*
 	int i = 0 ;
@@ -139,6 +184,49 @@ int process_file(std::string filepath) {
     return 0 ;
 }
 
+/**
+ * Merge the computed models into a single bundle file. The models already in the file are kept,
+ * except those whose image was computed again, which are replaced. With -r, a replaced model keeps
+ * the name and volume it had in the file, read from the file once rather than per model.
+ * */
+int write_models_to_bundle(const std::vector<std::string> &filepaths, std::vector<struct model_data> &models,
+	const std::vector<uchar> &is_computed, const std::string &bundle_path) {
+	std::map<std::string, struct model_data> model_of ;	//by image file
+	if(std::ifstream(bundle_path)) {
+		for(const auto &pair : load_model_bundle(bundle_path)) {
+			model_of[pair.second.source_image_path] = pair.second ;
+		}
+	}
+	const size_t num_existing = model_of.size() ;
+
+	for(size_t i = 0 ; i < filepaths.size() ; i++) {
+		if(!is_computed[i]) {
+			std::cerr << "The file is empty: " << filepaths[i] << std::endl ;
+			continue ;
+		}
+
+		struct model_data &model = models[i] ;
+		auto it = model_of.find(model.source_image_path) ;
+		if(it != model_of.end() && cmdopt_retain) {
+			model.drink_name = it->second.drink_name ;
+			model.drink_volume = it->second.drink_volume ;
+		}
+		model_of[model.source_image_path] = model ;
+	}
+
+	std::vector<struct model_data> written ;
+	for(const auto &pair : model_of) {
+		written.push_back(pair.second) ;
+	}
+
+	if(cmdopt_verbose) {
+		std::cout << "Output file: " << bundle_path << ", " << written.size() << " models, "
+			<< num_existing << " before" << std::endl ;
+	}
+
+	return write_model_bundle(bundle_path, written) ? 0 : -1 ;
+}
+
 /**
  * Returns the name of the drink and container volume, from the filename
  * */
@@ -18,8 +18,34 @@ using namespace cv ;
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <set>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <cstring>
+#include <cstdint>
 
 #include "histogram.hpp"
+#include "histogram_cache.hpp"
+#include "feature_extractor.hpp"
+
+//name of the manifest in the histograms directory. Not .yaml, so that it is not loaded as a model
+static const char *catalog_manifest_name = "catalog_manifest.yml" ;
+
+/**
+ * @brief The state of a model image when its histograms were last written
+ */
+struct catalog_entry {
+	std::string image_file ;
+	int size = 0 ;
+	int mtime_sec = 0 ;
+	int mtime_nsec = 0 ;
+	std::string hash ;	//hex FNV-1a of the contents
+	std::string features ;	//comma-separated extractors other than the H-S histograms
+} ;
 
 static bool cmdopt_verbose = false ;
 /**
@@ -105,7 +131,7 @@ struct model_data load_model_image(std::string img_path) {
 
 	Rect rc_center = inner_third(img) ;
 
-	std::vector<Mat> hist_set = generate_histogram_set(img, 10, 12) ;
+	std::vector<Mat> hist_set = feature_extractor(HS_HISTOGRAMS_FEATURE)->extract(img) ;
 
 	std::string fnamestr = std::string(img_path) ;
 	size_t lastindex = fnamestr.find_last_of(".") ;
@@ -147,13 +173,53 @@ void write_yaml_histograms(const HistogramDict model_of, const std::string hist_
 	}
 }
 
+/**
+ * @brief Compute the H-S histograms of a model image, and the features of any other extractors named
+ */
+void extract_model_features(const Mat &img, struct model_data &model, const std::vector<std::string> &feature_names) {
+	model.histograms = feature_extractor(HS_HISTOGRAMS_FEATURE)->extract(img) ;
+
+	model.features.clear() ;
+	for(const auto &name : feature_names) {
+		const auto extractor = feature_extractor(name) ;
+		if(extractor && name != HS_HISTOGRAMS_FEATURE) {
+			model.features[name] = extractor->extract(img) ;
+		}
+	}
+}
+
+/**
+ * @brief Write the fields of a model YAML file. The "features" sequence names the extractors whose
+ * output the file holds, so that a loader knows which labels to read.
+ */
+static void write_model_fields(FileStorage &fs, const struct model_data &model) {
+	fs << "name" << model.drink_name ;
+	fs << "volume" << model.drink_volume ;
+	fs << "image_file" << model.source_image_path ;
+
+	fs << "features" << "[" << HS_HISTOGRAMS_FEATURE ;
+	for(const auto &pair : model.features) {
+		fs << pair.first ;
+	}
+	fs << "]" ;
+
+	for(size_t i = 0 ; i < num_histogram_regions ; i++) {
+		fs << yaml_labels[i] << model.histograms[i] ;
+	}
+
+	for(const auto &pair : model.features) {
+		const std::vector<std::string> labels = feature_extractor(pair.first)->labels() ;
+		for(size_t i = 0 ; i < labels.size() && i < pair.second.size() ; i++) {
+			fs << labels[i] << pair.second[i] ;
+		}
+	}
+}
+
 void write_yaml_histogram(struct model_data model, const std::string yamlfile, bool is_retain) {
 	//If the YAML file already exists, first extract the name and volume to preserve them
-	struct stat path_stat;
-	stat(yamlfile.c_str(), &path_stat);
-
 	if(is_retain) {
-		if(S_ISREG(path_stat.st_mode)) {
+		struct stat path_stat ;
+		if(stat(yamlfile.c_str(), &path_stat) == 0 && S_ISREG(path_stat.st_mode)) {
 			//Read the name and volume fields
 			FileStorage fs(yamlfile, FileStorage::READ) ;
 
@@ -171,74 +237,247 @@ void write_yaml_histogram(struct model_data model, const std::string yamlfile, b
 	}
 
 	FileStorage fs(yamlfile, FileStorage::WRITE) ;
+	write_model_fields(fs, model) ;
+	fs.release() ;
+}
 
-	fs << "name" << model.drink_name ;
-	fs << "volume" << model.drink_volume ;
-	fs << "image_file" << model.source_image_path ;
+//header of a model bundle: magic, then the format version as a 32-bit native order integer
+static const char MODEL_BUNDLE_MAGIC[4] = { 'J', 'V', 'M', 'B' } ;
+static const uint32_t MODEL_BUNDLE_VERSION = 1 ;
 
-	const std::vector<Mat> hist_set = model.histograms ;
-	for(size_t i = 0 ; i < num_histogram_regions ; i++) {
-		fs << yaml_labels[i] << hist_set[i] ;
+static void bundle_put_u32(std::vector<char> &buf, uint32_t value) {
+	buf.insert(buf.end(), (const char *)&value, (const char *)&value + sizeof(value)) ;
+}
+
+static void bundle_put_string(std::vector<char> &buf, const std::string &str) {
+	bundle_put_u32(buf, str.size()) ;
+	buf.insert(buf.end(), str.begin(), str.end()) ;
+}
+
+static void bundle_put_mats(std::vector<char> &buf, const std::vector<Mat> &mats) {
+	bundle_put_u32(buf, mats.size()) ;
+	for(const auto &mat : mats) {
+		const Mat m = mat.isContinuous() ? mat : mat.clone() ;
+		bundle_put_u32(buf, m.rows) ;
+		bundle_put_u32(buf, m.cols) ;
+		bundle_put_u32(buf, m.type()) ;
+		buf.insert(buf.end(), (const char *)m.data, (const char *)m.data + m.total() * m.elemSize()) ;
 	}
+}
 
-	fs.release() ;
+/**
+ * @brief Reads the fields of a bundle in order, failing once any field would run past the end
+ */
+struct bundle_reader {
+	const std::vector<char> &buf ;
+	size_t pos ;
+	bool is_ok ;
+
+	bundle_reader(const std::vector<char> &buf, size_t pos) : buf(buf), pos(pos), is_ok(true) {}
+
+	bool has(size_t size) {
+		is_ok = is_ok && size <= buf.size() - pos ;
+		return is_ok ;
+	}
+
+	uint32_t u32() {
+		uint32_t value = 0 ;
+		if(has(sizeof(value))) {
+			memcpy(&value, buf.data() + pos, sizeof(value)) ;
+			pos += sizeof(value) ;
+		}
+		return value ;
+	}
+
+	std::string string() {
+		const uint32_t size = u32() ;
+		if(!has(size)) {
+			return "" ;
+		}
+		pos += size ;
+		return std::string(buf.data() + pos - size, size) ;
+	}
+
+	std::vector<Mat> mats() {
+		std::vector<Mat> result ;
+		const uint32_t count = u32() ;
+		for(uint32_t i = 0 ; i < count && is_ok ; i++) {
+			const int rows = u32() ;
+			const int cols = u32() ;
+			const int type = u32() ;
+			const size_t size = (size_t)rows * cols * CV_ELEM_SIZE(type) ;
+			if(!has(size)) {
+				break ;
+			}
+			result.push_back(Mat(rows, cols, type, (void *)(buf.data() + pos)).clone()) ;
+			pos += size ;
+		}
+		return result ;
+	}
+} ;
+
+/**
+ * @brief Write a set of models to a single binary file, in one streaming write,
+ * as the faster alternative to one YAML file per model. The file is written through a temporary file renamed over it.
+ *
+ * record: name, volume, image file, H-S histograms, number of other features, then the name and Mats of each.
+ * A string is its 32-bit length followed by its bytes. Mats are a 32-bit count followed by the rows, cols and type, then the data, of each.
+ *
+ * @return true if the file was written
+ */
+bool write_model_bundle(const std::string &path, const std::vector<struct model_data> &models) {
+	std::vector<char> buf(MODEL_BUNDLE_MAGIC, MODEL_BUNDLE_MAGIC + sizeof(MODEL_BUNDLE_MAGIC)) ;
+	bundle_put_u32(buf, MODEL_BUNDLE_VERSION) ;
+
+	for(const auto &model : models) {
+		bundle_put_string(buf, model.drink_name) ;
+		bundle_put_u32(buf, model.drink_volume) ;
+		bundle_put_string(buf, model.source_image_path) ;
+		bundle_put_mats(buf, model.histograms) ;
+
+		bundle_put_u32(buf, model.features.size()) ;
+		for(const auto &pair : model.features) {
+			bundle_put_string(buf, pair.first) ;
+			bundle_put_mats(buf, pair.second) ;
+		}
+	}
+
+	const std::string tmp_path = path + ".tmp" ;
+	{
+		std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc) ;
+		ofs.write(buf.data(), buf.size()) ;
+		if(!ofs) {
+			std::cerr << "Could not write " << tmp_path << std::endl ;
+			unlink(tmp_path.c_str()) ;
+			return false ;
+		}
+	}
+
+	if(rename(tmp_path.c_str(), path.c_str()) != 0) {
+		std::cerr << "Could not replace " << path << std::endl ;
+		unlink(tmp_path.c_str()) ;
+		return false ;
+	}
+	return true ;
+}
+
+/**
+ * @brief Load the models of a file written by write_model_bundle(), keyed by their image file name without extension
+ */
+HistogramDict load_model_bundle(const std::string &path) {
+	HistogramDict model_of ;
+
+	std::ifstream ifs(path, std::ios::binary) ;
+	if(!ifs) {
+		std::cerr << "Model bundle does not exist: " << path << std::endl ;
+		return model_of ;
+	}
+	const std::vector<char> buf((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>()) ;
+
+	if(buf.size() < sizeof(MODEL_BUNDLE_MAGIC) || memcmp(buf.data(), MODEL_BUNDLE_MAGIC, sizeof(MODEL_BUNDLE_MAGIC)) != 0) {
+		std::cerr << "Not a model bundle: " << path << std::endl ;
+		return model_of ;
+	}
+
+	bundle_reader reader(buf, sizeof(MODEL_BUNDLE_MAGIC)) ;
+	if(reader.u32() != MODEL_BUNDLE_VERSION) {
+		std::cerr << "Model bundle of another version: " << path << std::endl ;
+		return model_of ;
+	}
+
+	while(reader.is_ok && reader.pos < buf.size()) {
+		struct model_data model ;
+		model.drink_name = reader.string() ;
+		model.drink_volume = reader.u32() ;
+		model.source_image_path = reader.string() ;
+		model.histograms = reader.mats() ;
+
+		const uint32_t num_features = reader.u32() ;
+		for(uint32_t i = 0 ; i < num_features && reader.is_ok ; i++) {
+			const std::string name = reader.string() ;
+			model.features[name] = reader.mats() ;
+		}
+
+		if(!reader.is_ok || model.histograms.size() != (size_t)num_histogram_regions) {
+			std::cerr << "Model bundle is cut short, loaded " << model_of.size() << " models: " << path << std::endl ;
+			break ;
+		}
+
+		const std::string &image_file = model.source_image_path ;
+		model_of[image_file.substr(0, image_file.find_last_of("."))] = model ;
+	}
+
+	return model_of ;
 }
 
-HistogramDict load_model_images(std::string models_dir) {
+/**
+Load the model images in a directory and generate their histograms.
+The directory is listed first, then the images are decoded and histogrammed in parallel,
+each into its own slot of a preallocated vector, and finally gathered into the dictionary.
+*/
+HistogramDict load_model_images(std::string models_dir, const std::vector<std::string> &feature_names) {
 	DIR *pdir ;
 	struct dirent *entry ;
-	char *fname ;
 		
 	HistogramDict model_of ;
 
-	if((pdir = opendir(models_dir.c_str()))) {
-		while((entry = readdir(pdir))) {
-			fname = entry->d_name ;
-			std::string path = std::string(models_dir) + std::string("/") + fname ;
-			
-			struct stat path_stat;
-			int ret = stat(path.c_str(), &path_stat);
+	if(!(pdir = opendir(models_dir.c_str()))) {
+		std::cerr << "Model images directory does not exist: " << models_dir << std::endl ;
+		return model_of ;
+	}
 
-			if(0 != ret) {
-				std::cout << "stat() returned error " << errno << " on " << path << std::endl ;
-				std::cout << "Skipping this file." << std::endl ;
+	std::vector<std::string> fnames ;
+	while((entry = readdir(pdir))) {
+		const std::string fname = entry->d_name ;
+		std::string path = std::string(models_dir) + std::string("/") + fname ;
+		
+		struct stat path_stat;
+		int ret = stat(path.c_str(), &path_stat);
+
+		if(0 != ret) {
+			std::cout << "stat() returned error " << errno << " on " << path << std::endl ;
+			std::cout << "Skipping this file." << std::endl ;
+			continue ;
+		}
+
+		if(S_ISREG(path_stat.st_mode)) {
+			fnames.push_back(fname) ;
+		}
+	}	//ended stepping through directory
+	closedir(pdir) ;
+
+	std::vector<struct model_data> models(fnames.size()) ;
+
+	parallel_for_(Range(0, fnames.size()), [&](const Range &range) {
+		for(int i = range.start ; i < range.end ; i++) {
+			const std::string &fname = fnames[i] ;
+			const std::string path = std::string(models_dir) + std::string("/") + fname ;
+
+			Mat img = imread(path, 1) ;
+			if(img.empty()) {
 				continue ;
 			}
 
-			if(S_ISREG(path_stat.st_mode)) {
-				if(cmdopt_verbose) {
-					std::cout << "Loading model image: " << path << std::endl ;
-				}
-			
-				Mat img = imread(path, 1) ;
-			
-				Rect rc_center = inner_third(img) ;
+			std::string fnoext = fname.substr(0, fname.find_last_of(".")) ;
 
-				std::vector<Mat> hist_set = generate_histogram_set(img, 10, 12) ;
+			struct model_data &model = models[i] ;
+			extract_model_features(img, model, feature_names) ;
+			model.drink_name = fnoext ;
+			model.source_image_path = fname ;
+		}
+	}) ;
 
-				std::string fnamestr = std::string(fname) ;
-				size_t lastindex = fnamestr.find_last_of(".") ;
-				std::string fnoext = fnamestr.substr(0, lastindex) ;
-				std::string filename_extension = fnamestr.substr(lastindex + 1) ;
-				
-				//model_of[fnoext] = hist_set ;
-
-				struct model_data model ;
-				model.histograms = hist_set ;
-				model.drink_name = fnoext ;
-				model.source_image_path = fname ;
-				// model_histograms.push_back(hist_full) ;
-				// model_histogram_sets.push_back(hist_set) ;
-				// model_names.push_back(fnoext) ;
-				//model_of[fname] = model ;
-				model_of[fnoext] = model ;
-			} else {
-				// std::cout << fname << " is not a file?!" << std::endl ;
-			}
-		}	//ended stepping through directory
-	} else {
-		std::cerr << "Model images directory does not exist: " << models_dir << std::endl ;
+	for(size_t i = 0 ; i < models.size() ; i++) {
+		if(models[i].histograms.empty()) {
+			std::cerr << "Not a valid model image, skipping: " << fnames[i] << std::endl ;
+			continue ;
+		}
+		if(cmdopt_verbose) {
+			std::cout << "Loaded model image: " << fnames[i] << std::endl ;
+		}
+		model_of[models[i].drink_name] = models[i] ;
 	}
+
 	return model_of ;
 }
 
@@ -293,6 +532,24 @@ HistogramDict load_model_histograms(const std::string &models_dir) {
 					fs["image_file"] >> model.source_image_path ;
 					fs["volume"] >> model.drink_volume ;
 
+					//files written before features were recorded hold only the H-S histograms
+					const FileNode features = fs["features"] ;
+					for(auto it = features.begin() ; it != features.end() ; ++it) {
+						const std::string name = std::string(*it) ;
+						const auto extractor = feature_extractor(name) ;
+						if(!extractor || name == HS_HISTOGRAMS_FEATURE) {
+							continue ;
+						}
+
+						std::vector<Mat> feature_set ;
+						for(const auto &label : extractor->labels()) {
+							Mat feature ;
+							fs[label] >> feature ;
+							feature_set.push_back(feature) ;
+						}
+						model.features[name] = feature_set ;
+					}
+
 					fs.release() ;
 					
 
@@ -317,3 +574,281 @@ HistogramDict load_model_histograms(const std::string &models_dir) {
 	
 	return model_of ;
 }
+
+static std::map<std::string, catalog_entry> read_catalog_manifest(const std::string &manifest_path) {
+	std::map<std::string, catalog_entry> entry_of ;
+
+	struct stat path_stat ;
+	if(stat(manifest_path.c_str(), &path_stat) != 0) {
+		return entry_of ;
+	}
+
+	FileStorage fs(manifest_path, FileStorage::READ) ;
+	const FileNode models = fs["models"] ;
+	for(auto it = models.begin() ; it != models.end() ; ++it) {
+		const FileNode node = *it ;
+		catalog_entry entry ;
+		std::string name ;
+
+		node["name"] >> name ;
+		node["image_file"] >> entry.image_file ;
+		node["size"] >> entry.size ;
+		node["mtime_sec"] >> entry.mtime_sec ;
+		node["mtime_nsec"] >> entry.mtime_nsec ;
+		node["hash"] >> entry.hash ;
+		node["features"] >> entry.features ;
+
+		entry_of[name] = entry ;
+	}
+	fs.release() ;
+
+	return entry_of ;
+}
+
+/**
+ * @brief Write a file through a temporary file, renamed over it when complete,
+ * so that a reader never sees a partly written file
+ */
+static bool write_yaml_atomically(const std::string &path, std::function<void(FileStorage &)> write_fields) {
+	const std::string tmp_path = path + ".tmp" ;
+
+	{
+		FileStorage fs(tmp_path, FileStorage::WRITE | FileStorage::FORMAT_YAML) ;
+		if(!fs.isOpened()) {
+			std::cerr << "Could not write " << tmp_path << std::endl ;
+			return false ;
+		}
+		write_fields(fs) ;
+		fs.release() ;
+	}
+
+	if(rename(tmp_path.c_str(), path.c_str()) != 0) {
+		std::cerr << "Could not replace " << path << std::endl ;
+		unlink(tmp_path.c_str()) ;
+		return false ;
+	}
+	return true ;
+}
+
+static void write_catalog_manifest(const std::string &manifest_path, const std::map<std::string, catalog_entry> &entry_of) {
+	write_yaml_atomically(manifest_path, [&entry_of](FileStorage &fs) {
+		fs << "models" << "[" ;
+		for(const auto &pair : entry_of) {
+			const catalog_entry &entry = pair.second ;
+			fs << "{" ;
+			fs << "name" << pair.first ;
+			fs << "image_file" << entry.image_file ;
+			fs << "size" << entry.size ;
+			fs << "mtime_sec" << entry.mtime_sec ;
+			fs << "mtime_nsec" << entry.mtime_nsec ;
+			fs << "hash" << entry.hash ;
+			fs << "features" << entry.features ;
+			fs << "}" ;
+		}
+		fs << "]" ;
+	}) ;
+}
+
+/**
+ * @brief Update the model histogram YAML files to match the model images, recomputing only the images
+ * that were added or changed since the last update, and deleting the files of images that were removed.
+ * A manifest in hist_dir holds the size, modification time and content hash of each image.
+ * An image whose size or time changed is read and hashed, and only recomputed if its contents changed.
+ * Those images are read and recomputed in parallel, then their YAML files written one at a time.
+ *
+ * Each YAML file, and finally the manifest, is replaced by renaming a complete temporary file.
+ * If the update is interrupted, the manifest still describes the last complete update,
+ * and the next update redoes what was interrupted.
+ * The name and volume in an existing YAML file are kept, as with write_yaml_histogram(..., true).
+ *
+ * @param images_dir model images
+ * @param hist_dir model histogram YAML files
+ * @param is_full recompute all images, using the manifest only to find the removed ones
+ * @param feature_names extractors to store besides the H-S histograms. Models stored with other features are recomputed.
+ * @return catalog_update_counts number of models added, changed, removed and unchanged
+ */
+catalog_update_counts update_model_histograms(const std::string &images_dir, const std::string &hist_dir, bool is_full,
+	const std::vector<std::string> &feature_names) {
+	catalog_update_counts counts ;
+	const std::string manifest_path = hist_dir + "/" + catalog_manifest_name ;
+
+	//read even when recomputing everything, to find the models whose image is gone
+	const std::map<std::string, catalog_entry> old_entry_of = read_catalog_manifest(manifest_path) ;
+	std::map<std::string, catalog_entry> entry_of ;
+	std::set<std::string> present_names ;	//models with an image, even if it could not be processed
+
+	//sorted, so that the same set is recorded the same way
+	const std::set<std::string> feature_name_set(feature_names.begin(), feature_names.end()) ;
+	std::string features ;
+	for(const auto &name : feature_name_set) {
+		if(name != HS_HISTOGRAMS_FEATURE && feature_extractor(name)) {
+			features += (features.empty() ? "" : ",") + name ;
+		}
+	}
+
+	DIR *pdir = opendir(images_dir.c_str()) ;
+	if(!pdir) {
+		std::cerr << "Model images directory does not exist: " << images_dir << std::endl ;
+		return counts ;
+	}
+	mkdir(hist_dir.c_str(), 0755) ;
+
+	//an image that is new, or whose size or time changed
+	struct pending_image {
+		std::string name ;
+		std::string path ;
+		catalog_entry current ;
+		bool is_known ;		//in the manifest with the same file and features, and its YAML file present
+		bool is_yaml_present ;
+		enum { INVALID, TOUCHED, COMPUTED } outcome ;
+		struct model_data model ;
+	} ;
+	std::vector<pending_image> pendings ;
+
+	//first find the images to read, from the directory and the manifest only
+	struct dirent *entry ;
+	while((entry = readdir(pdir))) {
+		const std::string fname = entry->d_name ;
+		if(fname[0] == '.') {
+			continue ;
+		}
+
+		const std::string path = images_dir + "/" + fname ;
+		struct stat path_stat ;
+		if(stat(path.c_str(), &path_stat) != 0 || !S_ISREG(path_stat.st_mode)) {
+			continue ;
+		}
+
+		const std::string name = fname.substr(0, fname.find_last_of(".")) ;
+		const std::string yamlfile = hist_dir + "/" + name + ".yaml" ;
+		present_names.insert(name) ;
+
+		catalog_entry current ;
+		current.image_file = fname ;
+		current.size = path_stat.st_size ;
+		current.mtime_sec = path_stat.st_mtim.tv_sec ;
+		current.mtime_nsec = path_stat.st_mtim.tv_nsec ;
+		current.features = features ;
+
+		struct stat yaml_stat ;
+		const bool is_yaml_present = stat(yamlfile.c_str(), &yaml_stat) == 0 ;
+		auto it_old = old_entry_of.find(name) ;
+		const bool is_known = !is_full && it_old != old_entry_of.end() && it_old->second.image_file == fname && is_yaml_present &&
+			it_old->second.features == features ;
+
+		if(is_known && it_old->second.size == current.size &&
+			it_old->second.mtime_sec == current.mtime_sec && it_old->second.mtime_nsec == current.mtime_nsec) {
+			entry_of[name] = it_old->second ;
+			counts.unchanged++ ;
+			continue ;
+		}
+
+		pending_image pending ;
+		pending.name = name ;
+		pending.path = path ;
+		pending.current = current ;
+		pending.is_known = is_known ;
+		pending.is_yaml_present = is_yaml_present ;
+		pending.outcome = pending_image::INVALID ;
+		pendings.push_back(pending) ;
+	}
+	closedir(pdir) ;
+
+	//then read, hash and, if the contents changed, decode and extract them in parallel
+	parallel_for_(Range(0, pendings.size()), [&](const Range &range) {
+		for(int i = range.start ; i < range.end ; i++) {
+			pending_image &pending = pendings[i] ;
+
+			std::ifstream ifs(pending.path, std::ios::binary) ;
+			std::vector<uchar> contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>()) ;
+
+			//imdecode() throws on an empty buffer
+			if(!ifs || contents.empty()) {
+				continue ;
+			}
+
+			char hash_hex[17] ;
+			snprintf(hash_hex, sizeof(hash_hex), "%016llx", (unsigned long long)histogram_cache_key_of(contents).hash) ;
+			pending.current.hash = hash_hex ;
+
+			//touched, but not changed
+			if(pending.is_known && old_entry_of.at(pending.name).hash == pending.current.hash) {
+				pending.outcome = pending_image::TOUCHED ;
+				continue ;
+			}
+
+			const Mat img = imdecode(contents, 1) ;
+			if(img.empty()) {
+				continue ;
+			}
+
+			extract_model_features(img, pending.model, feature_names) ;
+			pending.model.drink_name = pending.name ;
+			pending.model.source_image_path = pending.current.image_file ;
+			pending.outcome = pending_image::COMPUTED ;
+		}
+	}) ;
+
+	//finally write the YAML files, in directory order
+	for(auto &pending : pendings) {
+		const std::string &name = pending.name ;
+
+		if(pending.outcome == pending_image::INVALID) {
+			std::cerr << "Not a valid model image, skipping: " << pending.path << std::endl ;
+			continue ;
+		}
+		if(pending.outcome == pending_image::TOUCHED) {
+			entry_of[name] = pending.current ;
+			counts.unchanged++ ;
+			continue ;
+		}
+
+		const std::string yamlfile = hist_dir + "/" + name + ".yaml" ;
+		struct model_data &model = pending.model ;
+
+		if(pending.is_yaml_present) {
+			FileStorage fs_old(yamlfile, FileStorage::READ) ;
+			std::string dn = std::string(fs_old["name"]) ;
+			fs_old["volume"] >> model.drink_volume ;
+			if(!dn.empty()) {
+				model.drink_name = dn ;
+			}
+			fs_old.release() ;
+		}
+
+		const bool is_written = write_yaml_atomically(yamlfile, [&model](FileStorage &fs) {
+			write_model_fields(fs, model) ;
+		}) ;
+
+		//the histograms are no longer needed once written
+		model = model_data() ;
+
+		auto it_old = old_entry_of.find(name) ;
+		if(!is_written && it_old != old_entry_of.end()) {
+			//the old file is left as it was, and redone next time
+			entry_of[name] = it_old->second ;
+			entry_of[name].hash.clear() ;
+		} else if(is_written) {
+			entry_of[name] = pending.current ;
+			if(it_old != old_entry_of.end()) {
+				counts.changed++ ;
+			} else {
+				counts.added++ ;
+			}
+		}
+	}
+
+	//models whose image is gone
+	for(const auto &pair : old_entry_of) {
+		if(present_names.count(pair.first) == 0) {
+			const std::string yamlfile = hist_dir + "/" + pair.first + ".yaml" ;
+			if(unlink(yamlfile.c_str()) == 0 || errno == ENOENT) {
+				counts.removed++ ;
+			}
+		}
+	}
+
+	write_catalog_manifest(manifest_path, entry_of) ;
+
+	return counts ;
+}
@@ -6,6 +6,7 @@ struct model_data {
 	std::string drink_name ;
 	int drink_volume = 0 ;
 	std::vector<cv::Mat> histograms ;
+	std::map<std::string, std::vector<cv::Mat> > features ;	//from other extractors, by extractor name
 } ;
 
 static const char *yaml_labels[] = {
@@ -21,6 +22,16 @@ static const char *yaml_labels[] = {
 
 typedef std::map<std::string, struct model_data> HistogramDict ;
 
+/**
+ * @brief What update_model_histograms() did to the catalog
+ */
+struct catalog_update_counts {
+	int added = 0 ;
+	int changed = 0 ;
+	int removed = 0 ;
+	int unchanged = 0 ;
+} ;
+
 const int num_histogram_regions = sizeof(yaml_labels) / sizeof(*yaml_labels) ;
 
 struct model_data load_model_image(std::string img_path) ;
@@ -31,4 +42,9 @@ cv::Rect inner_third(const cv::Mat m) ;
 void write_yaml_histograms(const HistogramDict hist_of, const std::string dir) ;
 void write_yaml_histogram(struct model_data model, const std::string yamlfile, bool is_retain=false) ;
 HistogramDict load_model_histograms(const std::string &models_dir) ;
-HistogramDict load_model_images(std::string dir) ;
\ No newline at end of file
+bool write_model_bundle(const std::string &path, const std::vector<struct model_data> &models) ;
+HistogramDict load_model_bundle(const std::string &path) ;
+HistogramDict load_model_images(std::string dir, const std::vector<std::string> &feature_names = std::vector<std::string>()) ;
+void extract_model_features(const cv::Mat &img, struct model_data &model, const std::vector<std::string> &feature_names) ;
+catalog_update_counts update_model_histograms(const std::string &images_dir, const std::string &hist_dir, bool is_full = false,
+	const std::vector<std::string> &feature_names = std::vector<std::string>()) ;
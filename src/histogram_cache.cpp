@@ -0,0 +1,270 @@
+/**
+ * @file histogram_cache.cpp
+ * @brief Histogram sets of images already seen, kept in a file across runs.
+ *
+ * The file is a 32-byte header followed by records of equal size, so it can be mapped and indexed
+ * by stepping through the keys, without parsing. A record is written with a single write() to a file
+ * opened with O_APPEND, so runs sharing the cache do not overwrite each other's records.
+ * A record cut short by an interrupted run is ignored, and dropped the next time the file is opened.
+ * Opening holds an exclusive flock() and appending a shared one, so that the drop cannot cut
+ * a record another run is still writing.
+ *
+ * header: "JVHC", version, h_bins, s_bins, number of regions, 12 reserved bytes, all 32-bit native order
+ * record: 64-bit hash, 64-bit file size, then the CV_32F bins of each region histogram in order
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#endif
+
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace cv ;
+
+#include "histogram.hpp"
+#include "histogram_cache.hpp"
+
+static const char HISTOGRAM_CACHE_MAGIC[4] = { 'J', 'V', 'H', 'C' } ;
+static const uint32_t HISTOGRAM_CACHE_VERSION = 1 ;
+
+struct histogram_cache_header {
+	char magic[4] ;
+	uint32_t version ;
+	uint32_t h_bins ;
+	uint32_t s_bins ;
+	uint32_t num_regions ;
+	uint32_t reserved[3] ;
+} ;
+
+/**
+ * @brief The key of an image file, from its contents as read from disk
+ */
+histogram_cache_key histogram_cache_key_of(const std::vector<uchar> &file_contents) {
+	uint64_t hash = 0xcbf29ce484222325ULL ;	//FNV-1a 64-bit offset basis
+
+	for(auto byte : file_contents) {
+		hash ^= byte ;
+		hash *= 0x100000001b3ULL ;	//FNV prime
+	}
+
+	return { hash, file_contents.size() } ;
+}
+
+HistogramCache::HistogramCache() : fd(-1), h_bins(0), s_bins(0), mapped(NULL), mapped_size(0), hits(0), misses(0) {}
+
+HistogramCache::~HistogramCache() {
+	close() ;
+}
+
+size_t HistogramCache::record_size() const {
+	return 2 * sizeof(uint64_t) + num_histogram_regions * h_bins * s_bins * sizeof(float) ;
+}
+
+/**
+ * @brief Open a cache file, creating it if it does not exist, and index its records
+ *
+ * @param path cache file
+ * @param h_bins hue bins of the histograms
+ * @param s_bins saturation bins of the histograms
+ * @return true if the cache can be used. False if it cannot be opened, or holds histograms of other dimensions.
+ */
+bool HistogramCache::open(const std::string &path, int h_bins, int s_bins) {
+	close() ;
+
+	this->h_bins = h_bins ;
+	this->s_bins = s_bins ;
+
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644) ;
+	if(fd < 0) {
+		std::cerr << "Could not open histogram cache " << path << std::endl ;
+		return false ;
+	}
+
+	//no other run appends while the header is written or a partial record dropped
+	if(flock(fd, LOCK_EX) != 0) {
+		std::cerr << "Could not lock histogram cache " << path << std::endl ;
+		close() ;
+		return false ;
+	}
+	const bool is_opened = open_locked(path) ;
+	if(fd >= 0) {
+		flock(fd, LOCK_UN) ;
+	}
+
+	return is_opened ;
+}
+
+/**
+ * @brief The part of open() done while holding the exclusive lock of the file
+ */
+bool HistogramCache::open_locked(const std::string &path) {
+
+	struct stat file_stat ;
+	fstat(fd, &file_stat) ;
+	size_t file_size = file_stat.st_size ;
+
+	if(file_size < sizeof(histogram_cache_header)) {
+		//new, or never completed its header
+		histogram_cache_header header ;
+		memset(&header, 0, sizeof(header)) ;
+		memcpy(header.magic, HISTOGRAM_CACHE_MAGIC, sizeof(header.magic)) ;
+		header.version = HISTOGRAM_CACHE_VERSION ;
+		header.h_bins = h_bins ;
+		header.s_bins = s_bins ;
+		header.num_regions = num_histogram_regions ;
+
+		if(ftruncate(fd, 0) != 0 || write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+			std::cerr << "Could not write histogram cache " << path << std::endl ;
+			close() ;
+			return false ;
+		}
+		return true ;
+	}
+
+	mapped = (const uchar *)mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0) ;
+	if(mapped == MAP_FAILED) {
+		mapped = NULL ;
+		std::cerr << "Could not map histogram cache " << path << std::endl ;
+		close() ;
+		return false ;
+	}
+	mapped_size = file_size ;
+
+	const histogram_cache_header *header = (const histogram_cache_header *)mapped ;
+	if(memcmp(header->magic, HISTOGRAM_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != HISTOGRAM_CACHE_VERSION ||
+		header->h_bins != (uint32_t)h_bins || header->s_bins != (uint32_t)s_bins ||
+		header->num_regions != (uint32_t)num_histogram_regions) {
+		std::cerr << "Histogram cache " << path << " holds histograms of other dimensions, not using it" << std::endl ;
+		close() ;
+		return false ;
+	}
+
+	const size_t num_records = (file_size - sizeof(histogram_cache_header)) / record_size() ;
+	const uchar *record = mapped + sizeof(histogram_cache_header) ;
+	for(size_t i = 0 ; i < num_records ; i++, record += record_size()) {
+		histogram_cache_key key ;
+		memcpy(&key.hash, record, sizeof(uint64_t)) ;
+		memcpy(&key.size, record + sizeof(uint64_t), sizeof(uint64_t)) ;
+		mapped_record_of[key] = record ;
+	}
+
+	//drop a partial record, so that appended records stay aligned
+	const size_t complete_size = sizeof(histogram_cache_header) + num_records * record_size() ;
+	if(complete_size != file_size && ftruncate(fd, complete_size) != 0) {
+		std::cerr << "Could not truncate the partial record of histogram cache " << path << std::endl ;
+	}
+
+	return true ;
+}
+
+void HistogramCache::close() {
+	if(mapped) {
+		munmap((void *)mapped, mapped_size) ;
+		mapped = NULL ;
+		mapped_size = 0 ;
+	}
+	if(fd >= 0) {
+		::close(fd) ;
+		fd = -1 ;
+	}
+	mapped_record_of.clear() ;
+	appended_of.clear() ;
+}
+
+/**
+ * @brief Get the histogram set of an image seen before
+ *
+ * @return true if the key is in the cache
+ */
+bool HistogramCache::find(const histogram_cache_key &key, std::vector<Mat> &histograms) {
+	std::lock_guard<std::mutex> lock(mtx) ;
+
+	auto it_mapped = mapped_record_of.find(key) ;
+	if(it_mapped != mapped_record_of.end()) {
+		const float *bins = (const float *)(it_mapped->second + 2 * sizeof(uint64_t)) ;
+
+		histograms.resize(num_histogram_regions) ;
+		for(int i = 0 ; i < num_histogram_regions ; i++) {
+			//copied, so that the histograms outlive the mapping
+			histograms[i] = Mat(h_bins, s_bins, CV_32F, (void *)(bins + i * h_bins * s_bins)).clone() ;
+		}
+		hits++ ;
+		return true ;
+	}
+
+	auto it_appended = appended_of.find(key) ;
+	if(it_appended != appended_of.end()) {
+		histograms = it_appended->second ;
+		hits++ ;
+		return true ;
+	}
+
+	misses++ ;
+	return false ;
+}
+
+/**
+ * @brief Add the histogram set of an image to the end of the file
+ *
+ * @param histograms as from generate_histogram_set(), with the dimensions the cache was opened with
+ * @return true if the record was written
+ */
+bool HistogramCache::append(const histogram_cache_key &key, const std::vector<Mat> &histograms) {
+	if(!is_open() || histograms.size() != (size_t)num_histogram_regions) {
+		return false ;
+	}
+
+	std::vector<uchar> record(record_size()) ;
+	memcpy(record.data(), &key.hash, sizeof(uint64_t)) ;
+	memcpy(record.data() + sizeof(uint64_t), &key.size, sizeof(uint64_t)) ;
+
+	float *bins = (float *)(record.data() + 2 * sizeof(uint64_t)) ;
+	for(const auto &hist : histograms) {
+		if(hist.type() != CV_32F || hist.rows != h_bins || hist.cols != s_bins) {
+			return false ;
+		}
+		Mat dest(h_bins, s_bins, CV_32F, bins) ;
+		hist.copyTo(dest) ;
+		bins += h_bins * s_bins ;
+	}
+
+	std::lock_guard<std::mutex> lock(mtx) ;
+
+	//shared, as O_APPEND already keeps the appends of several runs apart
+	flock(fd, LOCK_SH) ;
+	const bool is_written = write(fd, record.data(), record.size()) == (ssize_t)record.size() ;
+	flock(fd, LOCK_UN) ;
+
+	if(!is_written) {
+		std::cerr << "Could not append to the histogram cache" << std::endl ;
+		return false ;
+	}
+
+	std::vector<Mat> copies ;
+	for(const auto &hist : histograms) {
+		copies.push_back(hist.clone()) ;
+	}
+	appended_of[key] = copies ;
+
+	return true ;
+}
+
+void HistogramCache::print_stats(std::ostream &os) const {
+	std::lock_guard<std::mutex> lock(mtx) ;
+
+	os << "Histogram cache: " << hits << " found, " << misses << " computed, "
+		<< mapped_record_of.size() + appended_of.size() << " records" << std::endl ;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file histogram_cache.hpp
+ * @brief Histogram sets of images already seen, kept in a file across runs and looked up by the image contents,
+ * so that an image identified again is neither decoded nor histogrammed.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+/**
+ * @brief Identifies an image file by its contents
+ */
+struct histogram_cache_key {
+	uint64_t hash ;	//FNV-1a of the file contents
+	uint64_t size ;	//file size in bytes
+
+	bool operator==(const histogram_cache_key &other) const { return hash == other.hash && size == other.size ; }
+} ;
+
+histogram_cache_key histogram_cache_key_of(const std::vector<uchar> &file_contents) ;
+
+/**
+ * @brief An append-only file of fixed-size records, each the key and the histogram set of one image.
+ * The existing records are mapped into memory when the file is opened and indexed by key.
+ * Records appended later are also kept in memory for the rest of the run.
+ */
+class HistogramCache {
+public:
+	HistogramCache() ;
+	~HistogramCache() ;
+
+	bool open(const std::string &path, int h_bins, int s_bins) ;
+	void close() ;
+	bool is_open() const { return fd >= 0 ; }
+
+	bool find(const histogram_cache_key &key, std::vector<cv::Mat> &histograms) ;
+	bool append(const histogram_cache_key &key, const std::vector<cv::Mat> &histograms) ;
+
+	void print_stats(std::ostream &os) const ;
+
+private:
+	struct key_hash {
+		size_t operator()(const histogram_cache_key &key) const { return key.hash ^ key.size ; }
+	} ;
+
+	size_t record_size() const ;
+	bool open_locked(const std::string &path) ;
+
+	int fd ;
+	int h_bins, s_bins ;
+	const uchar *mapped ;
+	size_t mapped_size ;
+
+	std::unordered_map<histogram_cache_key, const uchar *, key_hash> mapped_record_of ;
+	std::unordered_map<histogram_cache_key, std::vector<cv::Mat>, key_hash> appended_of ;
+	mutable std::mutex mtx ;
+
+	size_t hits, misses ;
+} ;
@@ -0,0 +1,156 @@
+/**
+ * @file batch_correlation.cpp
+ * @brief Correlations of many target histogram sets with many model histogram sets, as one matrix product.
+ *
+ * The correlation compareHist() computes for two histograms a and b is the dot product of
+ * (a - mean(a)) / |a - mean(a)| and (b - mean(b)) / |b - mean(b)|.
+ * So each histogram set becomes one row of features, the histograms of its regions centered, scaled to unit length
+ * and laid end to end. The weights of the regions are folded into the target rows, and then
+ * the product of the target rows with the model rows is the combined correlation of every target with every model.
+ *
+ * As in combined_correlation(), the first region (the full image) is not included.
+ *
+ * A region histogram with no variance has no direction, and its features are all 0. compareHist() returns 1
+ * for a pair in which either histogram has no variance, and so does QuantizedCatalog. To match, each set also has
+ * a share of each region, 0 where it has no variance, and the product of the target and model shares is the weight
+ * of the regions where both vary. The weight of the others, 1 minus that, is added to the correlation.
+ *
+ * The features are CV_32F, so the correlations agree with those of combined_correlation() to float precision.
+ * correlation_parity_test checks that they are within 1e-5 of each other.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgproc.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#endif
+
+#include <algorithm>
+
+using namespace cv ;
+
+#include "batch_correlation.hpp"
+
+//regions from this index on are compared, as in combined_correlation()
+static const size_t FIRST_COMPARED_REGION = 1 ;
+
+/**
+Generate a value representing the similarity of the target image to
+the model image using histograms of several sub-regions of the image.
+It is a weighted combination of the correlations of the histograms of the regions of the image
+*/
+double combined_correlation(const std::vector<Mat> &hist_set_base, const std::vector<Mat> &hist_set_model, const std::vector<int> &region_weights) {
+	double corr, total = 0 ;
+	const int compare_method = 0 ; //correlation
+	int num_corrs = 0 ;
+		
+	//skip the first one which is already evaluated (with double weight)
+	for(size_t i = FIRST_COMPARED_REGION ; i < hist_set_base.size() ; i++) {
+		const int weight = region_weights[i] ;
+		const Mat h_base  = hist_set_base[i] ;
+		const Mat h_model = hist_set_model[i];
+		total += weight * compareHist(h_base, h_model, compare_method) ;
+		num_corrs += weight ;
+	}
+		
+	corr = total / num_corrs ;
+	return corr ;
+}
+
+/**
+ * @brief One row of features for each histogram set
+ *
+ * @param hist_sets histogram sets, all with the same number of regions and bins
+ * @param region_weights weight of each region in the combined correlation
+ * @param is_weighted whether to scale each region by its share of the total weight. Apply to one side of the product only.
+ * @param region_shares receives CV_32F, one row per set, one column per compared region:
+ * the share of the region as its features are scaled, 1 or its share of the weight, or 0 if it has no variance
+ * @return Mat CV_32F, one row per set
+ */
+Mat histogram_feature_matrix(const std::vector<std::vector<Mat> > &hist_sets, const std::vector<int> &region_weights, bool is_weighted,
+	Mat &region_shares) {
+	if(hist_sets.empty()) {
+		region_shares = Mat() ;
+		return Mat() ;
+	}
+
+	const size_t num_regions = hist_sets[0].size() ;
+	const int bins = hist_sets[0][0].total() ;
+
+	int total_weight = 0 ;
+	for(size_t r = FIRST_COMPARED_REGION ; r < num_regions ; r++) {
+		total_weight += region_weights[r] ;
+	}
+
+	Mat features(hist_sets.size(), (num_regions - FIRST_COMPARED_REGION) * bins, CV_32F) ;
+	region_shares.create(hist_sets.size(), num_regions - FIRST_COMPARED_REGION, CV_32F) ;
+
+	parallel_for_(Range(0, hist_sets.size()), [&](const Range &range) {
+		for(int i = range.start ; i < range.end ; i++) {
+			for(size_t r = FIRST_COMPARED_REGION ; r < num_regions ; r++) {
+				Mat hist ;
+				hist_sets[i][r].reshape(1, 1).convertTo(hist, CV_32F) ;
+
+				Mat feature = features.row(i).colRange((r - FIRST_COMPARED_REGION) * bins, (r - FIRST_COMPARED_REGION + 1) * bins) ;
+				subtract(hist, mean(hist), feature) ;
+
+				const double len = norm(feature) ;
+				const double scale = is_weighted ? double(region_weights[r]) / total_weight : 1.0 ;
+				feature.convertTo(feature, -1, (len > 0) ? scale / len : 0.0) ;
+				region_shares.at<float>(i, r - FIRST_COMPARED_REGION) = (len > 0) ? scale : 0.0 ;
+			}
+		}
+	}) ;
+
+	return features ;
+}
+
+/**
+ * @brief Combined correlation of every target with every model
+ *
+ * @param target_features from histogram_feature_matrix() with is_weighted
+ * @param model_features from histogram_feature_matrix() without is_weighted
+ * @param target_shares region shares of the targets, from the same call as target_features
+ * @param model_shares region shares of the models, from the same call as model_features
+ * @return Mat CV_32F, one row per target, one column per model
+ */
+Mat correlation_matrix(const Mat &target_features, const Mat &model_features, const Mat &target_shares, const Mat &model_shares) {
+	Mat correlations, both_varying ;
+	gemm(target_features, model_features, 1.0, noArray(), 0.0, correlations, GEMM_2_T) ;
+
+	//the regions where either has no variance correlate 1, as in compareHist()
+	gemm(target_shares, model_shares, 1.0, noArray(), 0.0, both_varying, GEMM_2_T) ;
+	subtract(correlations, both_varying, correlations) ;
+	add(correlations, Scalar::all(1.0), correlations) ;
+
+	return correlations ;
+}
+
+/**
+ * @brief The k highest correlations of a target, highest first
+ *
+ * @return std::vector<std::pair<float, int> > correlation and model column
+ */
+std::vector<std::pair<float, int> > top_correlations(const Mat &correlations, int row, int k, double min_correlation) {
+	std::vector<std::pair<float, int> > matches ;
+	const float *corr = correlations.ptr<float>(row) ;
+
+	for(int col = 0 ; col < correlations.cols ; col++) {
+		if(corr[col] > min_correlation) {
+			matches.push_back(std::make_pair(corr[col], col)) ;
+		}
+	}
+
+	const size_t num_top = std::min(matches.size(), (size_t)std::max(k, 0)) ;
+	std::partial_sort(matches.begin(), matches.begin() + num_top, matches.end(),
+		[](const std::pair<float, int> &a, const std::pair<float, int> &b) { return a.first > b.first ; }) ;
+	matches.resize(num_top) ;
+
+	return matches ;
+}
@@ -0,0 +1,20 @@
+/**
+ * @file batch_correlation.hpp
+ * @brief Correlations of many target histogram sets with many model histogram sets, as one matrix product
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+
+double combined_correlation(const std::vector<cv::Mat> &hist_set_base, const std::vector<cv::Mat> &hist_set_model,
+	const std::vector<int> &region_weights) ;
+cv::Mat histogram_feature_matrix(const std::vector<std::vector<cv::Mat> > &hist_sets,
+	const std::vector<int> &region_weights, bool is_weighted, cv::Mat &region_shares) ;
+cv::Mat correlation_matrix(const cv::Mat &target_features, const cv::Mat &model_features,
+	const cv::Mat &target_shares, const cv::Mat &model_shares) ;
+std::vector<std::pair<float, int> > top_correlations(const cv::Mat &correlations, int row, int k, double min_correlation = -1.0) ;
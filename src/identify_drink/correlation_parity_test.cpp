@@ -0,0 +1,210 @@
+/**
+ * @file correlation_parity_test.cpp
+ * @brief The batch and quantized correlations checked against combined_correlation(), on fixed-seed histogram sets
+ *
+ * The models are random sets shaped like those of generate_histogram_set(): 10x12 CV_32F bins scaled to 0..1,
+ * a few peaks over a sparse background. Each target is a model with noise added to its bins, so its best match is known.
+ * Some models and targets have a flat region, all bins 0, which every path must correlate 1 with anything.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#endif
+
+#include <gtest/gtest.h>
+
+using namespace cv ;
+
+#include "batch_correlation.hpp"
+#include "quantized_catalog.hpp"
+
+static const int H_BINS = 10 ;
+static const int S_BINS = 12 ;
+static const int NUM_REGIONS = 6 ;
+static const int NUM_MODELS = 100 ;
+static const int NUM_TARGETS = 40 ;
+
+//as in identify_drink
+static const int region_weights_array[] = { 2, 1, 1, 2, 1, 1 } ;
+static const std::vector<int> region_weights(region_weights_array, region_weights_array + NUM_REGIONS) ;
+
+static const double BATCH_TOLERANCE = 1e-5 ;
+static const double QUANTIZED_16_TOLERANCE = 1e-4 ;
+static const double QUANTIZED_8_TOLERANCE = 1e-2 ;
+
+/**
+ * @brief A histogram of a few peaks over a sparse background, scaled to 0..1
+ */
+static Mat random_histogram(RNG &rng) {
+	Mat hist(H_BINS, S_BINS, CV_32F, Scalar(0)) ;
+
+	const int num_peaks = rng.uniform(1, 6) ;
+	for(int p = 0 ; p < num_peaks ; p++) {
+		const int h = rng.uniform(0, H_BINS) ;
+		const int s = rng.uniform(0, S_BINS) ;
+		hist.at<float>(h, s) += rng.uniform(0.1f, 1.0f) ;
+	}
+
+	float *bins = hist.ptr<float>(0) ;
+	for(int i = 0 ; i < H_BINS * S_BINS ; i++) {
+		if(rng.uniform(0, 4) == 0) {
+			bins[i] += rng.uniform(0.0f, 0.05f) ;
+		}
+	}
+
+	normalize(hist, hist, 0, 1, NORM_MINMAX) ;
+	return hist ;
+}
+
+/**
+ * @brief The histogram sets of the test, built once
+ */
+struct parity_sets {
+	std::vector<std::vector<Mat> > models ;
+	std::vector<std::vector<Mat> > targets ;
+	std::vector<int> source_models ;	//the model each target was made from
+
+	parity_sets() {
+		RNG rng(20261019) ;
+
+		for(int m = 0 ; m < NUM_MODELS ; m++) {
+			std::vector<Mat> hist_set ;
+			for(int r = 0 ; r < NUM_REGIONS ; r++) {
+				hist_set.push_back(random_histogram(rng)) ;
+			}
+			if(m % 7 == 3) {
+				hist_set[1 + m % 5] = Mat::zeros(H_BINS, S_BINS, CV_32F) ;
+			}
+			models.push_back(hist_set) ;
+		}
+
+		for(int t = 0 ; t < NUM_TARGETS ; t++) {
+			const int source = (t * 37) % NUM_MODELS ;
+			source_models.push_back(source) ;
+
+			std::vector<Mat> hist_set ;
+			for(int r = 0 ; r < NUM_REGIONS ; r++) {
+				Mat hist = models[source][r].clone() ;
+
+				//a flat region of the model stays flat
+				if(countNonZero(hist) > 0) {
+					float *bins = hist.ptr<float>(0) ;
+					for(int i = 0 ; i < H_BINS * S_BINS ; i++) {
+						bins[i] += rng.uniform(-0.03f, 0.03f) ;
+					}
+					hist = max(hist, 0.0) ;
+					normalize(hist, hist, 0, 1, NORM_MINMAX) ;
+				}
+				hist_set.push_back(hist) ;
+			}
+			if(t % 5 == 0) {
+				hist_set[1 + (t / 5) % 5] = Mat::zeros(H_BINS, S_BINS, CV_32F) ;
+			}
+			targets.push_back(hist_set) ;
+		}
+	}
+} ;
+
+static const parity_sets &sets() {
+	static const parity_sets the_sets ;
+	return the_sets ;
+}
+
+/**
+ * @brief combined_correlation() of every target with every model, CV_64F
+ */
+static Mat reference_correlations() {
+	Mat correlations(NUM_TARGETS, NUM_MODELS, CV_64F) ;
+	for(int t = 0 ; t < NUM_TARGETS ; t++) {
+		for(int m = 0 ; m < NUM_MODELS ; m++) {
+			correlations.at<double>(t, m) = combined_correlation(sets().targets[t], sets().models[m], region_weights) ;
+		}
+	}
+	return correlations ;
+}
+
+static Mat batch_correlations() {
+	Mat target_shares, model_shares ;
+	const Mat target_features = histogram_feature_matrix(sets().targets, region_weights, true, target_shares) ;
+	const Mat model_features = histogram_feature_matrix(sets().models, region_weights, false, model_shares) ;
+	return correlation_matrix(target_features, model_features, target_shares, model_shares) ;
+}
+
+static Mat quantized_correlations(int bits) {
+	QuantizedCatalog catalog(bits) ;
+	catalog.build(sets().models) ;
+	return catalog.correlations(sets().targets, region_weights) ;
+}
+
+/**
+ * @brief Check that every correlation is within tolerance of combined_correlation(),
+ * and that the best match of each target is the model it was made from
+ */
+static void expect_parity(const Mat &correlations, double tolerance) {
+	ASSERT_EQ(correlations.rows, NUM_TARGETS) ;
+	ASSERT_EQ(correlations.cols, NUM_MODELS) ;
+
+	Mat expected = reference_correlations(), actual ;
+	correlations.convertTo(actual, CV_64F) ;
+
+	for(int t = 0 ; t < NUM_TARGETS ; t++) {
+		for(int m = 0 ; m < NUM_MODELS ; m++) {
+			EXPECT_NEAR(actual.at<double>(t, m), expected.at<double>(t, m), tolerance) << "target " << t << ", model " << m ;
+		}
+
+		Point best ;
+		minMaxLoc(actual.row(t), NULL, NULL, NULL, &best) ;
+		EXPECT_EQ(best.x, sets().source_models[t]) << "target " << t ;
+	}
+}
+
+TEST(CorrelationParity, CombinedFindsSourceModel) {
+	const Mat expected = reference_correlations() ;
+	for(int t = 0 ; t < NUM_TARGETS ; t++) {
+		Point best ;
+		minMaxLoc(expected.row(t), NULL, NULL, NULL, &best) ;
+		EXPECT_EQ(best.x, sets().source_models[t]) << "target " << t ;
+	}
+}
+
+TEST(CorrelationParity, BatchMatchesCombined) {
+	expect_parity(batch_correlations(), BATCH_TOLERANCE) ;
+}
+
+TEST(CorrelationParity, Quantized16MatchesCombined) {
+	expect_parity(quantized_correlations(16), QUANTIZED_16_TOLERANCE) ;
+}
+
+TEST(CorrelationParity, Quantized8MatchesCombined) {
+	expect_parity(quantized_correlations(8), QUANTIZED_8_TOLERANCE) ;
+}
+
+TEST(CorrelationParity, FlatRegionsCorrelateOne) {
+	const std::vector<Mat> flat_set(NUM_REGIONS, Mat::zeros(H_BINS, S_BINS, CV_32F)) ;
+	const std::vector<std::vector<Mat> > flat_sets(1, flat_set) ;
+	const std::vector<std::vector<Mat> > model_sets(1, sets().models[0]) ;
+
+	EXPECT_DOUBLE_EQ(combined_correlation(flat_set, sets().models[0], region_weights), 1.0) ;
+
+	Mat target_shares, model_shares ;
+	const Mat target_features = histogram_feature_matrix(flat_sets, region_weights, true, target_shares) ;
+	const Mat model_features = histogram_feature_matrix(model_sets, region_weights, false, model_shares) ;
+	EXPECT_NEAR(correlation_matrix(target_features, model_features, target_shares, model_shares).at<float>(0, 0), 1.0, BATCH_TOLERANCE) ;
+
+	for(int bits : { 8, 16 }) {
+		QuantizedCatalog catalog(bits) ;
+		catalog.build(model_sets) ;
+		EXPECT_NEAR(catalog.correlations(flat_sets, region_weights).at<float>(0, 0), 1.0, BATCH_TOLERANCE) << bits << " bits" ;
+	}
+}
+
+int main(int argc, char **argv) {
+	testing::InitGoogleTest(&argc, argv) ;
+	return RUN_ALL_TESTS() ;
+}
@@ -20,15 +20,22 @@
 #include <map>
 
 #include "histogram.hpp"
+#include "histogram_cache.hpp"
+#include "feature_extractor.hpp"
+#include "batch_correlation.hpp"
+#include "quantized_catalog.hpp"
+#include "match_cascade.hpp"
+#include "model_catalog.hpp"
 
 using namespace cv ;
 
-void process_file(std::string filename, HistogramDict hist_of) ;
+void process_file(std::string filename, const catalog_snapshot &catalog) ;
+void process_files_batched(const std::vector<std::string> &filenames, const catalog_snapshot &catalog) ;
+bool target_histogram_set(const std::string &filename, int h_bins, int s_bins, std::vector<Mat> &target_histograms) ;
+void print_parity_report(const QuantizedCatalog &catalog, const Mat &model_features, const Mat &float_correlations, const Mat &quantized_correlations) ;
 
 Rect inner_third(Mat m) ;
 
-double combined_correlation(std::vector<Mat> hist_set_base, std::vector<Mat> hist_set_model) ;
-
 static const int region_weights[] = {
 	2,
 	1,
@@ -54,20 +61,56 @@ void print_json(double corr, const struct model_data &model, std::string &filena
 
 
 static bool cmdopt_generate_histograms = false;
+static bool cmdopt_full_generate = false ;
 static bool cmdopt_verbose = false ;
 static bool cmdopt_best = false ;
 bool cmdopt_yaml = false ;
 bool cmdopt_target_name = false ;
 double min_correlation_to_display = -1.0 ;
+std::string cmdoptval_cache_file ;
+int cmdoptval_top_k = 0 ;	//with more than 0, score all targets at once
+int cmdoptval_quantized_bits = 0 ;	//8 or 16 to score against quantized models
+bool cmdopt_parity = false ;
+cascade_params cmdoptval_cascade ;
+std::vector<std::string> cmdoptval_features ;	//extractors to store besides the H-S histograms
+static bool cmdopt_daemon = false ;
+std::string cmdoptval_bundle_file ;
+int cmdoptval_reload_interval = 5 ;	//seconds
+
+//the models, with the first stage of the per-target comparison, reloaded in daemon mode
+ModelCatalog model_catalog ;
+//what the first stage rejected
+cascade_counters match_cascade_counters ;
+
+//targets scored in one matrix product
+static const size_t BATCH_TARGETS = 1024 ;
+
+//histogram sets of target images seen in earlier runs
+HistogramCache target_cache ;
 
 void help() {
 	std::cout << "identify_drinks" << std::endl ;
 	std::cout << "  -b : show only best (maximum correlation)" << std::endl ;
 	std::cout << "  -c correlation : minimum correlation to display" << std::endl ;
-	std::cout << "  -g : generate histograms" << std::endl ;
+	std::cout << "  -C file : cache of target image histograms, created if it does not exist" << std::endl ;
+	std::cout << "  -g : generate histograms, for the model images added or changed since the last time" << std::endl ;
+	std::cout << "  -F : generate histograms for all model images (implies -g)" << std::endl ;
+	std::cout << "  -f names : with -g, also store these features, comma-separated:" ;
+	for(const auto &name : feature_extractor_names()) {
+		std::cout << " " << name ;
+	}
+	std::cout << std::endl ;
 	std::cout << "  -d dir : model images directory" << std::endl ;
+	std::cout << "  -D : serve: read target files from standard input, one per line, reloading the models when their YAML files change (implies -y)" << std::endl ;
 	std::cout << "  -j dir : model histogram data subdirectory" << std::endl ;
+	std::cout << "  -k num : score all targets against all models at once, and show the best num matches of each, best first" << std::endl ;
+	std::cout << "  -l num : compare each target fully with at most num models, those with the closest hue signatures" << std::endl ;
+	std::cout << "  -m file : load the models from a file written by generate_histogram -o" << std::endl ;
 	std::cout << "  -n : print target drink name in output line" << std::endl ;
+	std::cout << "  -P : with -k and -q, report how far the quantized correlations are from the float ones" << std::endl ;
+	std::cout << "  -q bits : with -k, store the models as 8 or 16-bit histograms, and correlate in integers" << std::endl ;
+	std::cout << "  -R sec : with -D, seconds between looks for changed models, 0 for never" << std::endl ;
+	std::cout << "  -s correlation : compare each target fully only with models whose hue signature correlates at least this much" << std::endl ;
 	std::cout << "  -v : verbose" << std::endl ;
 	std::cout << "  -y : use YAML histogram files" << std::endl ;
 }
@@ -83,7 +126,7 @@ int main(int argc, char *argv[]) {
 		exit(0) ;
 	}
 
-	while((c = getopt(argc, argv, "bc:ghd:j:nvy")) != -1) {
+	while((c = getopt(argc, argv, "bc:C:DFf:ghd:j:k:l:m:nPq:R:s:vy")) != -1) {
 		switch(c) {
 			case 'b':
 				cmdopt_best = true ;
@@ -92,6 +135,20 @@ int main(int argc, char *argv[]) {
 				cvalue = optarg ;
 				min_correlation_to_display = std::stod(cvalue) ;
 				break ;
+			case 'C':
+				cmdoptval_cache_file = optarg ;
+				break ;
+			case 'D':
+				cmdopt_daemon = true ;
+				cmdopt_yaml = true ;
+				break ;
+			case 'F':
+				cmdopt_full_generate = true ;
+				cmdopt_generate_histograms = true ;
+				break ;
+			case 'f':
+				cmdoptval_features = parse_feature_names(optarg) ;
+				break ;
 			case 'g':
 				cmdopt_generate_histograms = true ;
 				break;
@@ -106,9 +163,34 @@ int main(int argc, char *argv[]) {
 				cvalue = optarg ;
 				model_histograms_subdir = cvalue ;
 				break ;
+			case 'k':
+				cmdoptval_top_k = atoi(optarg) ;
+				break ;
+			case 'l':
+				cmdoptval_cascade.max_shortlist = atoi(optarg) ;
+				break ;
+			case 'm':
+				cmdoptval_bundle_file = optarg ;
+				break ;
 			case 'n':
 				cmdopt_target_name = true ;
 				break ;				
+			case 'P':
+				cmdopt_parity = true ;
+				break ;
+			case 'q':
+				cmdoptval_quantized_bits = atoi(optarg) ;
+				if(cmdoptval_quantized_bits != 8 && cmdoptval_quantized_bits != 16) {
+					std::cerr << "Quantized histograms are 8 or 16 bits" << std::endl ;
+					exit(-1) ;
+				}
+				break ;
+			case 'R':
+				cmdoptval_reload_interval = atoi(optarg) ;
+				break ;
+			case 's':
+				cmdoptval_cascade.min_signature_correlation = std::stod(optarg) ;
+				break ;
 			case 'v':
 				cmdopt_verbose = true ;
 				break ;
@@ -131,40 +213,109 @@ int main(int argc, char *argv[]) {
 
 	//just generate YAML histograms from image model files, no input
 	if(cmdopt_generate_histograms) {
-		model_of = load_model_images(images_dir) ;
-		write_yaml_histograms(model_of, histograms_dir) ;
+		const auto counts = update_model_histograms(images_dir, histograms_dir, cmdopt_full_generate, cmdoptval_features) ;
+		if(cmdopt_verbose) {
+			std::cout << "Models added: " << counts.added << ", changed: " << counts.changed
+				<< ", removed: " << counts.removed << ", unchanged: " << counts.unchanged << std::endl ;
+		}
 		exit(0) ;
 	}
 
-	if(optind >= argc) {
+	if(optind >= argc && !cmdopt_daemon) {
 		std::cerr << "No input files." << std::endl ;
 		exit(-1) ;
 	} else {
 		// std::cout << "Number of input files:" << (argc - optind) << std::endl ;
 	}
 
-	if(cmdopt_yaml) {
+	if(!cmdoptval_bundle_file.empty()) {
+		model_of = load_model_bundle(cmdoptval_bundle_file) ;
+	} else if(cmdopt_yaml) {
 		model_of = load_model_histograms(histograms_dir) ;
 		// model_of = load_model_histograms(histograms_dir, images_dir) ;
 	} else {
 		model_of = load_model_images(images_dir) ;
 	}
 
+	if(model_of.empty()) {
+		std::cerr << "No models loaded." << std::endl ;
+		exit(-1) ;
+	}
+
+	if(cmdoptval_top_k > 0) {
+		model_catalog.set_batch_scoring(std::vector<int>(region_weights, region_weights + num_histogram_regions), cmdoptval_quantized_bits,
+			cmdopt_parity) ;
+	}
+	model_catalog.publish(model_of) ;
+	const auto catalog = model_catalog.snapshot() ;
+
+	if(!cmdoptval_cache_file.empty()) {
+		const auto &any_model = model_of.begin()->second ;
+		target_cache.open(cmdoptval_cache_file, any_model.histograms[0].rows, any_model.histograms[0].cols) ;
+	}
+
+	std::vector<std::string> batch_filenames ;
+
 	for (int idx = optind ; idx < argc ; idx++) {
 		filename = argv[idx] ;
 
 		// std::cout << filename << std::endl ;
 		std::ifstream ifile(filename) ;
 		if(ifile) {
+			if(cmdoptval_top_k > 0) {
+				batch_filenames.push_back(filename) ;
+				continue ;
+			}
 			if(cmdopt_verbose) {
 				std::cout << "Processing file:" << filename << std::endl ;
 			}
-			process_file(filename, model_of) ;    
+			process_file(filename, *catalog) ;    
 		} else {
 			std::cerr << "File does not exist: " << filename << std::endl ;
 		}
 	}
 
+	for(size_t start = 0 ; start < batch_filenames.size() ; start += BATCH_TARGETS) {
+		const size_t end = std::min(start + BATCH_TARGETS, batch_filenames.size()) ;
+		process_files_batched(std::vector<std::string>(batch_filenames.begin() + start, batch_filenames.begin() + end), *catalog) ;
+	}
+
+	if(cmdopt_daemon) {
+		//a bundle is not watched, only the YAML files
+		if(cmdoptval_reload_interval > 0 && cmdoptval_bundle_file.empty()) {
+			model_catalog.start_watching(histograms_dir, cmdoptval_reload_interval, cmdopt_verbose) ;
+		}
+
+		//each query is scored against the version current when it arrives
+		std::string line ;
+		while(std::getline(std::cin, line)) {
+			if(line.empty()) {
+				continue ;
+			}
+			if(!std::ifstream(line)) {
+				std::cerr << "File does not exist: " << line << std::endl ;
+				continue ;
+			}
+
+			const auto current = model_catalog.snapshot() ;
+			if(cmdoptval_top_k > 0) {
+				process_files_batched(std::vector<std::string>(1, line), *current) ;
+			} else {
+				process_file(line, *current) ;
+			}
+			std::cout << std::flush ;
+		}
+
+		model_catalog.stop_watching() ;
+	}
+
+	if(cmdopt_verbose && target_cache.is_open()) {
+		target_cache.print_stats(std::cout) ;
+	}
+	if(cmdopt_verbose && cmdoptval_cascade.is_enabled()) {
+		match_cascade_counters.print(std::cout) ;
+	}
+
 	return 0 ;
 }
 
@@ -174,32 +325,27 @@ int main(int argc, char *argv[]) {
 /**
  * Process file
  */
-void process_file(std::string filename, const HistogramDict model_of) {
-	const Mat src = imread(filename, 1) ; 
-	if(src.empty()) {
-		std::cerr << "Image is empty: " << filename << std::endl ;
-	}
-
-	if(cmdopt_verbose) {
-		std::cout << "Loading target image: " << filename << std::endl ;
-	}
-
-	const auto any_model = model_of.begin()->second ;
+void process_file(std::string filename, const catalog_snapshot &catalog) {
+	const auto &any_model = catalog.model_of.begin()->second ;
 	auto mat_rows = any_model.histograms[0].rows ;
 	auto mat_cols = any_model.histograms[0].cols ;
 
-	std::vector<Mat> target_histograms = generate_histogram_set(src, mat_rows, mat_cols) ;
+	std::vector<Mat> target_histograms ;
+	if(!target_histogram_set(filename, mat_rows, mat_cols, target_histograms)) {
+		return ;
+	}
 
+	const std::vector<int> weights(region_weights, region_weights + num_histogram_regions) ;
 	std::map<double, struct model_data> match_of ;
 
 	double best_correlation = -1.0 ;
 	struct model_data best_model ;
 
-	for(const auto &pair : model_of) {	
-		const std::string name = pair.first ;
-		struct model_data model = pair.second ;
+	//only the models that pass the first stage of the cascade
+	for(const auto *shortlisted : catalog.cascade.shortlist(target_histograms, cmdoptval_cascade, match_cascade_counters)) {	
+		struct model_data model = *shortlisted ;
 		
-		const auto this_correlation = combined_correlation(target_histograms, model.histograms) ;
+		const auto this_correlation = combined_correlation(target_histograms, model.histograms, weights) ;
 		// std::cout << this_correlation << " : " << pair.second.drink_name << " : " << pair.second.source_image_path << std::endl ;	
 		match_of[this_correlation] = model ;	//std::map is automatically sorted by key
 
@@ -227,27 +373,134 @@ void process_file(std::string filename, const HistogramDict model_of) {
 }
 
 /**
-Generate a value representing the similarity of the target image to
-the model image using histograms of several sub-regions of the image.
-It is a weighted combination of the correlations of the histograms of the regions of the image
-*/
-double combined_correlation(const std::vector<Mat> hist_set_base, const std::vector<Mat> hist_set_model) {
-	double corr, total = 0 ;
-	const int compare_method = 0 ; //correlation
-	int num_corrs = 0 ;
-		
-	//skip the first one which is already evaluated (with double weight)
-	for(size_t i = 1 ; i < hist_set_base.size() ; i++) {
-		const int weight = region_weights[i] ;
-		const Mat h_base  = hist_set_base[i] ;
-		const Mat h_model = hist_set_model[i];
-		// std::cout << h_base.type() << ", " << h_model.type() << std::endl ;
-		total += weight * compareHist(h_base, h_model, compare_method) ;
-		num_corrs += weight ;
+ * The histogram set of a target image, from the cache if it is open and has the image
+ */
+bool target_histogram_set(const std::string &filename, int mat_rows, int mat_cols, std::vector<Mat> &target_histograms) {
+	if(target_cache.is_open()) {
+		//the file is read once, for the key and, if it is not in the cache, for decoding
+		std::ifstream ifs(filename, std::ios::binary) ;
+		std::vector<uchar> contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>()) ;
+
+		//imdecode() throws on an empty buffer, where imread() just returns an empty Mat
+		if(!ifs || contents.empty()) {
+			std::cerr << "Image is empty: " << filename << std::endl ;
+			return false ;
 		}
-		
-	corr = total / num_corrs ;
-	return corr ;
+
+		const auto key = histogram_cache_key_of(contents) ;
+
+		if(!target_cache.find(key, target_histograms)) {
+			if(cmdopt_verbose) {
+				std::cout << "Loading target image: " << filename << std::endl ;
+			}
+
+			const Mat src = imdecode(contents, 1) ;
+			if(src.empty()) {
+				std::cerr << "Image is empty: " << filename << std::endl ;
+				return false ;
+			}
+			target_histograms = generate_histogram_set(src, mat_rows, mat_cols) ;
+			target_cache.append(key, target_histograms) ;
+		}
+	} else {
+		const Mat src = imread(filename, 1) ; 
+		if(src.empty()) {
+			std::cerr << "Image is empty: " << filename << std::endl ;
+			return false ;
+		}
+
+		if(cmdopt_verbose) {
+			std::cout << "Loading target image: " << filename << std::endl ;
+		}
+
+		target_histograms = generate_histogram_set(src, mat_rows, mat_cols) ;
+	}
+
+	return true ;
+}
+
+/**
+ * Score a batch of target files against all models with one matrix product,
+ * and print the best matches of each target, best first
+ */
+void process_files_batched(const std::vector<std::string> &filenames, const catalog_snapshot &catalog) {
+	const std::vector<int> weights(region_weights, region_weights + num_histogram_regions) ;
+
+	//built once for the snapshot, by ModelCatalog::publish()
+	const std::vector<const struct model_data *> &models = catalog.batch_models ;
+	const Mat &model_features = catalog.model_features ;
+
+	const auto &any_model = *models.front() ;
+	const int mat_rows = any_model.histograms[0].rows ;
+	const int mat_cols = any_model.histograms[0].cols ;
+
+	std::vector<std::vector<Mat> > target_sets(filenames.size()) ;
+	std::vector<uchar> is_loaded(filenames.size(), 0) ;
+
+	parallel_for_(Range(0, filenames.size()), [&](const Range &range) {
+		for(int i = range.start ; i < range.end ; i++) {
+			is_loaded[i] = target_histogram_set(filenames[i], mat_rows, mat_cols, target_sets[i]) ;
+		}
+	}) ;
+
+	std::vector<std::string> loaded_filenames ;
+	std::vector<std::vector<Mat> > loaded_sets ;
+	for(size_t i = 0 ; i < filenames.size() ; i++) {
+		if(is_loaded[i]) {
+			loaded_filenames.push_back(filenames[i]) ;
+			loaded_sets.push_back(target_sets[i]) ;
+		}
+	}
+	if(loaded_sets.empty()) {
+		return ;
+	}
+
+	Mat correlations ;
+	if(cmdoptval_quantized_bits > 0) {
+		correlations = catalog.quantized.correlations(loaded_sets, weights) ;
+
+		if(cmdopt_parity) {
+			Mat target_shares ;
+			const Mat target_features = histogram_feature_matrix(loaded_sets, weights, true, target_shares) ;
+			const Mat float_correlations = correlation_matrix(target_features, model_features, target_shares, catalog.model_region_shares) ;
+			print_parity_report(catalog.quantized, model_features, float_correlations, correlations) ;
+		}
+	} else {
+		Mat target_shares ;
+		const Mat target_features = histogram_feature_matrix(loaded_sets, weights, true, target_shares) ;
+		correlations = correlation_matrix(target_features, model_features, target_shares, catalog.model_region_shares) ;
+	}
+
+	for(size_t row = 0 ; row < loaded_filenames.size() ; row++) {
+		std::string target_filename = loaded_filenames[row] ;
+		for(const auto &match : top_correlations(correlations, row, cmdoptval_top_k, min_correlation_to_display)) {
+			print_csv(match.first, *models[match.second], target_filename) ;
+		}
+	}
+}
+
+/**
+Compare the correlations from the quantized models with those from the float models, on stderr
+*/
+void print_parity_report(const QuantizedCatalog &catalog, const Mat &model_features, const Mat &float_correlations, const Mat &quantized_correlations) {
+	Mat diff ;
+	absdiff(float_correlations, quantized_correlations, diff) ;
+
+	double max_diff ;
+	minMaxLoc(diff, NULL, &max_diff) ;
+
+	int same_best = 0 ;
+	for(int row = 0 ; row < diff.rows ; row++) {
+		Point best_float, best_quantized ;
+		minMaxLoc(float_correlations.row(row), NULL, NULL, NULL, &best_float) ;
+		minMaxLoc(quantized_correlations.row(row), NULL, NULL, NULL, &best_quantized) ;
+		same_best += (best_float == best_quantized) ;
+	}
+
+	std::cerr << "Quantized models: " << catalog.bytes() / 1024 << " KiB, float: "
+		<< model_features.total() * model_features.elemSize() / 1024 << " KiB" << std::endl ;
+	std::cerr << "Correlation difference: max " << max_diff << ", mean " << mean(diff)[0] << std::endl ;
+	std::cerr << "Same best match: " << same_best << " of " << diff.rows << " targets" << std::endl ;
 }
 
 void print_csv(double corr, const struct model_data &model, std::string &filename) {
@@ -0,0 +1,116 @@
+/**
+ * @file match_cascade.cpp
+ * @brief Prune the models to a shortlist by a cheap hue signature, before the full region-weighted comparison.
+ *
+ * The hue signature of a histogram set is the full-image histogram summed over saturation, leaving one value
+ * per hue bin, centered and scaled to unit length. The correlation of two signatures is then their dot product,
+ * a handful of multiplications against the several hundred of combined_correlation().
+ * Drinks whose dominant colors differ are rejected at this stage.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#endif
+
+#include <string>
+#include <map>
+#include <algorithm>
+
+using namespace cv ;
+
+#include "histogram.hpp"
+#include "match_cascade.hpp"
+
+/**
+ * @brief The hue signature of a histogram set, from its full-image histogram
+ *
+ * @return Mat CV_32F, 1 x hue bins
+ */
+Mat hue_signature(const std::vector<Mat> &hist_set) {
+	Mat hist, signature ;
+	hist_set[0].convertTo(hist, CV_32F) ;
+
+	//rows are hue bins, columns saturation bins
+	reduce(hist, signature, 1, REDUCE_SUM) ;
+	signature = signature.reshape(1, 1) ;
+
+	subtract(signature, mean(signature), signature) ;
+	const double len = norm(signature) ;
+	signature.convertTo(signature, -1, (len > 0) ? 1.0 / len : 0.0) ;
+
+	return signature ;
+}
+
+/**
+ * @brief Compute the signatures of the models. The models must outlive the cascade.
+ */
+void MatchCascade::build(const HistogramDict &model_of) {
+	models.clear() ;
+	signatures.release() ;
+
+	for(const auto &pair : model_of) {
+		models.push_back(&pair.second) ;
+		signatures.push_back(hue_signature(pair.second.histograms)) ;
+	}
+}
+
+/**
+ * @brief The models that go on to the full comparison with a target
+ *
+ * @param target_set histogram set of the target
+ * @param params limits of the first stage
+ * @param counters add the models rejected by each stage
+ * @return std::vector<const struct model_data *> the shortlist, in the order of the dictionary
+ */
+std::vector<const struct model_data *> MatchCascade::shortlist(const std::vector<Mat> &target_set, const cascade_params &params,
+	cascade_counters &counters) const {
+	counters.targets++ ;
+	counters.models_considered += models.size() ;
+
+	if(!params.is_enabled() || models.empty()) {
+		counters.fully_compared += models.size() ;
+		return models ;
+	}
+
+	Mat correlations ;
+	gemm(signatures, hue_signature(target_set), 1.0, noArray(), 0.0, correlations, GEMM_2_T) ;
+
+	std::vector<std::pair<float, size_t> > passed ;
+	for(size_t i = 0 ; i < models.size() ; i++) {
+		const float corr = correlations.at<float>(i) ;
+		if(corr >= params.min_signature_correlation) {
+			passed.push_back(std::make_pair(corr, i)) ;
+		}
+	}
+	counters.rejected_by_signature += models.size() - passed.size() ;
+
+	if(params.max_shortlist > 0 && passed.size() > params.max_shortlist) {
+		std::nth_element(passed.begin(), passed.begin() + params.max_shortlist, passed.end(),
+			[](const std::pair<float, size_t> &a, const std::pair<float, size_t> &b) { return a.first > b.first ; }) ;
+		counters.rejected_by_shortlist += passed.size() - params.max_shortlist ;
+		passed.resize(params.max_shortlist) ;
+	}
+
+	std::sort(passed.begin(), passed.end(),
+		[](const std::pair<float, size_t> &a, const std::pair<float, size_t> &b) { return a.second < b.second ; }) ;
+
+	std::vector<const struct model_data *> result ;
+	for(const auto &p : passed) {
+		result.push_back(models[p.second]) ;
+	}
+	counters.fully_compared += result.size() ;
+
+	return result ;
+}
+
+void cascade_counters::print(std::ostream &os) const {
+	os << "Cascade: " << targets << " targets, " << models_considered << " model comparisons considered, "
+		<< rejected_by_signature << " rejected by hue signature, " << rejected_by_shortlist << " by shortlist length, "
+		<< fully_compared << " fully compared" << std::endl ;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file match_cascade.hpp
+ * @brief Prune the models to a shortlist by a cheap hue signature, before the full region-weighted comparison
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <iostream>
+
+/**
+ * @brief What the first stage keeps. With neither limit set, every model goes on to the full comparison.
+ */
+struct cascade_params {
+	double min_signature_correlation = -1.0 ;	//reject models whose hue signature correlates less
+	size_t max_shortlist = 0 ;					//keep at most this many, best signatures first. 0 for no limit
+
+	bool is_enabled() const { return min_signature_correlation > -1.0 || max_shortlist > 0 ; }
+} ;
+
+/**
+ * @brief How many models each stage rejected, over all targets
+ */
+struct cascade_counters {
+	size_t targets = 0 ;
+	size_t models_considered = 0 ;
+	size_t rejected_by_signature = 0 ;
+	size_t rejected_by_shortlist = 0 ;
+	size_t fully_compared = 0 ;
+
+	void print(std::ostream &os) const ;
+} ;
+
+cv::Mat hue_signature(const std::vector<cv::Mat> &hist_set) ;
+
+class MatchCascade {
+public:
+	void build(const HistogramDict &model_of) ;
+	std::vector<const struct model_data *> shortlist(const std::vector<cv::Mat> &target_set, const cascade_params &params,
+		cascade_counters &counters) const ;
+
+private:
+	std::vector<const struct model_data *> models ;
+	cv::Mat signatures ;	//one row per model
+} ;
@@ -0,0 +1,228 @@
+/**
+ * @file model_catalog.cpp
+ * @brief The models that targets are scored against, replaced as a whole while queries are being served.
+ *
+ * Publishing is a copy-on-write swap of a shared_ptr. The watcher builds a complete snapshot, models and cascade,
+ * before any reader can see it, and the old snapshot lives on in the readers that took it.
+ * The watcher polls the histograms directory and reloads it when the names, sizes or modification times
+ * of its YAML files change. A load that fails, as on a file caught half written, keeps the current snapshot
+ * and is retried at the next poll.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#endif
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+#include <dirent.h>
+
+using namespace cv ;
+
+#include "histogram.hpp"
+#include "match_cascade.hpp"
+#include "batch_correlation.hpp"
+#include "quantized_catalog.hpp"
+#include "model_catalog.hpp"
+
+/**
+ * @brief Changes when a YAML file in the directory is added, removed, or rewritten
+ */
+static std::string histograms_dir_signature(const std::string &histograms_dir) {
+	std::vector<std::string> stamps ;
+
+	DIR *pdir = opendir(histograms_dir.c_str()) ;
+	if(!pdir) {
+		return "" ;
+	}
+
+	struct dirent *entry ;
+	while((entry = readdir(pdir))) {
+		const std::string fname = entry->d_name ;
+		if(fname.size() < 5 || fname.compare(fname.size() - 5, 5, ".yaml") != 0) {
+			continue ;
+		}
+
+		const std::string path = histograms_dir + "/" + fname ;
+		struct stat path_stat ;
+		if(stat(path.c_str(), &path_stat) != 0) {
+			continue ;
+		}
+		stamps.push_back(fname + ":" + std::to_string(path_stat.st_size) + ":" +
+			std::to_string(path_stat.st_mtim.tv_sec) + "." + std::to_string(path_stat.st_mtim.tv_nsec)) ;
+	}
+	closedir(pdir) ;
+
+	std::sort(stamps.begin(), stamps.end()) ;
+
+	std::string signature ;
+	for(const auto &stamp : stamps) {
+		signature += stamp + "/" ;
+	}
+	return signature ;
+}
+
+/**
+ * @brief Whether every model has a full set of non-empty histograms of the given dimensions,
+ * as a file cut short or not written by this tool may not
+ */
+static bool is_valid_catalog(const HistogramDict &model_of, Size hist_size) {
+	for(const auto &pair : model_of) {
+		const std::vector<Mat> &histograms = pair.second.histograms ;
+		bool is_valid = histograms.size() == (size_t)num_histogram_regions ;
+
+		for(size_t i = 0 ; is_valid && i < histograms.size() ; i++) {
+			is_valid = !histograms[i].empty() && histograms[i].type() == CV_32F && histograms[i].size() == hist_size ;
+		}
+
+		if(!is_valid) {
+			std::cerr << "Model without a full set of histograms, not publishing the catalog: " << pair.first << std::endl ;
+			return false ;
+		}
+	}
+	return true ;
+}
+
+ModelCatalog::ModelCatalog() : last_version(0), batch_quantized_bits(0), is_batch_float_kept(false), is_stopping(false) {}
+
+ModelCatalog::~ModelCatalog() {
+	stop_watching() ;
+}
+
+/**
+ * @brief The current version, or NULL if nothing was published yet. Safe to call from any thread.
+ */
+std::shared_ptr<const catalog_snapshot> ModelCatalog::snapshot() const {
+	return std::atomic_load(&current) ;
+}
+
+/**
+ * @brief Have every version published from now on carry the model features for scoring many targets at once,
+ * so that they are built once per version rather than for each batch of targets
+ *
+ * @param region_weights weight of each region in the combined correlation
+ * @param quantized_bits 8 or 16 to build a QuantizedCatalog instead of the float features, 0 for the float features
+ * @param is_float_kept build the float features as well as the QuantizedCatalog, to compare the two
+ */
+void ModelCatalog::set_batch_scoring(const std::vector<int> &region_weights, int quantized_bits, bool is_float_kept) {
+	batch_region_weights = region_weights ;
+	batch_quantized_bits = quantized_bits ;
+	is_batch_float_kept = is_float_kept ;
+}
+
+/**
+ * @brief Make a set of models the current version
+ *
+ * @return the version number given to it
+ */
+unsigned long ModelCatalog::publish(HistogramDict model_of) {
+	std::shared_ptr<catalog_snapshot> next = std::make_shared<catalog_snapshot>() ;
+
+	next->version = ++last_version ;
+	next->model_of.swap(model_of) ;
+	next->cascade.build(next->model_of) ;
+
+	if(!batch_region_weights.empty()) {
+		//one row per model, in the order of the dictionary
+		std::vector<std::vector<Mat> > model_sets ;
+		for(const auto &pair : next->model_of) {
+			next->batch_models.push_back(&pair.second) ;
+			model_sets.push_back(pair.second.histograms) ;
+		}
+
+		if(batch_quantized_bits == 0 || is_batch_float_kept) {
+			next->model_features = histogram_feature_matrix(model_sets, batch_region_weights, false, next->model_region_shares) ;
+		}
+
+		if(batch_quantized_bits > 0) {
+			next->quantized = QuantizedCatalog(batch_quantized_bits) ;
+			next->quantized.build(model_sets) ;
+		}
+	}
+
+	std::atomic_store(&current, std::shared_ptr<const catalog_snapshot>(next)) ;
+	return next->version ;
+}
+
+/**
+ * @brief Load the YAML histogram files of a directory and publish them
+ *
+ * @return true if any models were loaded and published
+ */
+bool ModelCatalog::reload(const std::string &histograms_dir) {
+	try {
+		HistogramDict model_of = load_model_histograms(histograms_dir) ;
+		if(model_of.empty()) {
+			return false ;
+		}
+
+		//as the models already published, or else as the first model
+		const auto published = snapshot() ;
+		const auto &reference = (published ? published->model_of : model_of).begin()->second.histograms ;
+		if(!is_valid_catalog(model_of, reference[0].size())) {
+			return false ;
+		}
+
+		publish(model_of) ;
+	} catch (std::exception &e) {
+		//anything escaping the watcher thread would end the process
+		std::cerr << "Could not load the models in " << histograms_dir << ": " << e.what() << std::endl ;
+		return false ;
+	}
+
+	return true ;
+}
+
+/**
+ * @brief Start a thread that reloads the directory whenever its YAML files change
+ *
+ * @param interval_sec seconds between looks at the directory
+ */
+void ModelCatalog::start_watching(const std::string &histograms_dir, int interval_sec, bool is_verbose) {
+	stop_watching() ;
+	is_stopping = false ;
+
+	watcher = std::thread([this, histograms_dir, interval_sec, is_verbose]() {
+		std::string loaded_signature = histograms_dir_signature(histograms_dir) ;
+
+		std::unique_lock<std::mutex> lock(watcher_mtx) ;
+		while(!watcher_cv.wait_for(lock, std::chrono::seconds(interval_sec), [this]() { return is_stopping ; })) {
+			const std::string signature = histograms_dir_signature(histograms_dir) ;
+			if(signature == loaded_signature) {
+				continue ;
+			}
+
+			//readers are not held up by the load, only stop_watching() is
+			if(reload(histograms_dir)) {
+				loaded_signature = signature ;
+				if(is_verbose) {
+					const auto published = snapshot() ;
+					std::cerr << "Models reloaded: version " << published->version << ", "
+						<< published->model_of.size() << " models" << std::endl ;
+				}
+			}
+		}
+	}) ;
+}
+
+void ModelCatalog::stop_watching() {
+	if(!watcher.joinable()) {
+		return ;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(watcher_mtx) ;
+		is_stopping = true ;
+	}
+	watcher_cv.notify_all() ;
+	watcher.join() ;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file model_catalog.hpp
+ * @brief The models that targets are scored against, replaced as a whole while queries are being served
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief One version of the catalog. Never modified once published, so it is read without locks.
+ */
+struct catalog_snapshot {
+	unsigned long version = 0 ;
+	HistogramDict model_of ;
+	MatchCascade cascade ;	//built over model_of, pointing into it
+
+	//for scoring many targets at once, built if the catalog has batch scoring set
+	std::vector<const struct model_data *> batch_models ;	//the model of each row of model_features
+	cv::Mat model_features ;	//from histogram_feature_matrix(), empty if only the quantized models are kept
+	cv::Mat model_region_shares ;	//from the same call
+	QuantizedCatalog quantized ;	//empty unless quantized bits were set
+} ;
+
+/**
+ * @brief Holds the current snapshot. Readers take a reference to it and score against it for as long as they like,
+ * while a watcher thread loads a new version and publishes it by swapping the pointer.
+ * A snapshot is freed when the last reader holding it lets go.
+ */
+class ModelCatalog {
+public:
+	ModelCatalog() ;
+	~ModelCatalog() ;
+
+	std::shared_ptr<const catalog_snapshot> snapshot() const ;
+	void set_batch_scoring(const std::vector<int> &region_weights, int quantized_bits, bool is_float_kept = false) ;
+	unsigned long publish(HistogramDict model_of) ;
+	bool reload(const std::string &histograms_dir) ;
+
+	void start_watching(const std::string &histograms_dir, int interval_sec, bool is_verbose = false) ;
+	void stop_watching() ;
+
+private:
+	std::shared_ptr<const catalog_snapshot> current ;	//accessed only through std::atomic_load and std::atomic_store
+	std::atomic<unsigned long> last_version ;
+
+	std::vector<int> batch_region_weights ;	//empty if no batch scoring
+	int batch_quantized_bits ;
+	bool is_batch_float_kept ;
+
+	std::thread watcher ;
+	std::mutex watcher_mtx ;
+	std::condition_variable watcher_cv ;
+	bool is_stopping ;
+} ;
@@ -0,0 +1,193 @@
+/**
+ * @file quantized_catalog.cpp
+ * @brief Model histograms stored as 8 or 16-bit bins, correlated with targets in integer arithmetic.
+ *
+ * Each histogram is scaled so that its largest bin is the largest quantized value, and the scale is kept
+ * to recover the bins. Correlation does not depend on the scale of either histogram, so it is computed
+ * directly from the quantized bins, as compareHist() does from float bins:
+ *
+ *   (n * sum(a * b) - sum(a) * sum(b)) / sqrt((n * sum(a * a) - sum(a)^2) * (n * sum(b * b) - sum(b)^2))
+ *
+ * Only sum(a * b) depends on the pair. It is an integer dot product, which the compiler vectorizes
+ * into multiply-add instructions. The other sums are computed once per histogram.
+ * Each histogram also keeps a 4-byte scale and 16 bytes of sums. With the 10x12 H-S bins that is 140 bytes
+ * at 8 bits and 260 at 16 bits, against 480 as float bins: about 3.4 and 1.8 times less.
+ *
+ * As in combined_correlation(), the first region (the full image) is not stored or compared.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#endif
+
+#include <cmath>
+#include <algorithm>
+
+using namespace cv ;
+
+#include "quantized_catalog.hpp"
+
+static const size_t FIRST_COMPARED_REGION = 1 ;
+
+QuantizedCatalog::QuantizedCatalog(int bits) : bits(bits == 16 ? 16 : 8), model_count(0), num_regions(0), num_bins(0) {}
+
+/**
+ * @brief Quantize one histogram, and compute its sums
+ */
+template<typename T> void QuantizedCatalog::quantize(const Mat &hist, T *bins, float &scale, bin_sums &sums) const {
+	Mat hist_f ;
+	hist.reshape(1, 1).convertTo(hist_f, CV_32F) ;
+	const float *values = hist_f.ptr<float>(0) ;
+
+	double max_value ;
+	minMaxLoc(hist_f, NULL, &max_value) ;
+	const double max_quantized = (1 << bits) - 1 ;
+	scale = (max_value > 0) ? float(max_value / max_quantized) : 1.0f ;
+
+	int64_t sum = 0, sum_sq = 0 ;
+	for(int i = 0 ; i < num_bins ; i++) {
+		const T q = (T)std::min(max_quantized, std::max(0.0, std::round(double(values[i]) / scale))) ;
+		bins[i] = q ;
+		sum += q ;
+		sum_sq += (int64_t)q * q ;
+	}
+
+	sums.sum = sum ;
+	sums.spread = std::sqrt(std::max(0.0, double(num_bins) * sum_sq - double(sum) * sum)) ;
+}
+
+/**
+ * @brief Quantize the model histograms. Replaces any models built before.
+ *
+ * @param model_sets histogram sets, all with the same number of regions and bins
+ */
+void QuantizedCatalog::build(const std::vector<std::vector<Mat> > &model_sets) {
+	model_count = model_sets.size() ;
+	num_regions = model_sets.empty() ? 0 : model_sets[0].size() - FIRST_COMPARED_REGION ;
+	num_bins = model_sets.empty() ? 0 : model_sets[0][0].total() ;
+
+	const size_t num_hists = model_count * num_regions ;
+	bins8.assign(bits == 8 ? num_hists * num_bins : 0, 0) ;
+	bins16.assign(bits == 16 ? num_hists * num_bins : 0, 0) ;
+	scales.assign(num_hists, 0) ;
+	sums.assign(num_hists, bin_sums()) ;
+
+	parallel_for_(Range(0, model_count), [&](const Range &range) {
+		for(int m = range.start ; m < range.end ; m++) {
+			for(size_t r = 0 ; r < num_regions ; r++) {
+				const size_t h = m * num_regions + r ;
+				const Mat &hist = model_sets[m][r + FIRST_COMPARED_REGION] ;
+				if(bits == 8) {
+					quantize(hist, &bins8[h * num_bins], scales[h], sums[h]) ;
+				} else {
+					quantize(hist, &bins16[h * num_bins], scales[h], sums[h]) ;
+				}
+			}
+		}
+	}) ;
+}
+
+/**
+ * @brief Integer dot product of two quantized histograms
+ */
+static inline int64_t dot_bins(const uint8_t *a, const uint8_t *b, int n) {
+	//255 * 255 * n fits in 32 bits for any histogram size in use
+	int32_t dot = 0 ;
+	for(int i = 0 ; i < n ; i++) {
+		dot += int32_t(a[i]) * int32_t(b[i]) ;
+	}
+	return dot ;
+}
+
+static inline int64_t dot_bins(const uint16_t *a, const uint16_t *b, int n) {
+	int64_t dot = 0 ;
+	for(int i = 0 ; i < n ; i++) {
+		dot += int64_t(uint32_t(a[i]) * uint32_t(b[i])) ;
+	}
+	return dot ;
+}
+
+/**
+ * @brief Combined correlation of one target with every model
+ */
+template<typename T> void QuantizedCatalog::correlate_target(const std::vector<Mat> &target_set, const std::vector<int> &region_weights,
+	float *target_correlations) const {
+	const T *model_bins = (const T *)(bits == 8 ? (const void *)bins8.data() : (const void *)bins16.data()) ;
+
+	std::vector<T> target_bins(num_regions * num_bins) ;
+	std::vector<bin_sums> target_sums(num_regions) ;
+	int total_weight = 0 ;
+	for(size_t r = 0 ; r < num_regions ; r++) {
+		float scale ;
+		quantize(target_set[r + FIRST_COMPARED_REGION], &target_bins[r * num_bins], scale, target_sums[r]) ;
+		total_weight += region_weights[r + FIRST_COMPARED_REGION] ;
+	}
+
+	for(size_t m = 0 ; m < model_count ; m++) {
+		double total = 0 ;
+		for(size_t r = 0 ; r < num_regions ; r++) {
+			const size_t h = m * num_regions + r ;
+			const int64_t dot = dot_bins(&target_bins[r * num_bins], model_bins + h * num_bins, num_bins) ;
+
+			//as compareHist(), a histogram with no variance correlates 1
+			const double denom = target_sums[r].spread * sums[h].spread ;
+			const double corr = (denom > 0) ?
+				(double(num_bins) * dot - double(target_sums[r].sum) * sums[h].sum) / denom : 1.0 ;
+
+			total += region_weights[r + FIRST_COMPARED_REGION] * corr ;
+		}
+		target_correlations[m] = float(total / total_weight) ;
+	}
+}
+
+/**
+ * @brief Combined correlation of every target with every model, as combined_correlation() computes it
+ *
+ * @param target_sets histogram sets of the targets, with the regions and bins of the models
+ * @param region_weights weight of each region
+ * @return Mat CV_32F, one row per target, one column per model
+ */
+Mat QuantizedCatalog::correlations(const std::vector<std::vector<Mat> > &target_sets, const std::vector<int> &region_weights) const {
+	Mat result(target_sets.size(), model_count, CV_32F) ;
+
+	parallel_for_(Range(0, target_sets.size()), [&](const Range &range) {
+		for(int t = range.start ; t < range.end ; t++) {
+			if(bits == 8) {
+				correlate_target<uint8_t>(target_sets[t], region_weights, result.ptr<float>(t)) ;
+			} else {
+				correlate_target<uint16_t>(target_sets[t], region_weights, result.ptr<float>(t)) ;
+			}
+		}
+	}) ;
+
+	return result ;
+}
+
+/**
+ * @brief Recover a model histogram, with the bins and shape of the quantized values
+ *
+ * @param region index among the compared regions, so 0 is the first region after the full image
+ */
+Mat QuantizedCatalog::histogram(size_t model, size_t region) const {
+	const size_t h = model * num_regions + region ;
+	Mat hist(1, num_bins, CV_32F) ;
+	for(int i = 0 ; i < num_bins ; i++) {
+		const float q = (bits == 8) ? bins8[h * num_bins + i] : bins16[h * num_bins + i] ;
+		hist.at<float>(i) = q * scales[h] ;
+	}
+	return hist ;
+}
+
+/**
+ * @brief Memory taken by the bins, scales and sums
+ */
+size_t QuantizedCatalog::bytes() const {
+	return bins8.size() * sizeof(uint8_t) + bins16.size() * sizeof(uint16_t) +
+		scales.size() * sizeof(float) + sums.size() * sizeof(bin_sums) ;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file quantized_catalog.hpp
+ * @brief Model histograms stored as 8 or 16-bit bins, correlated with targets in integer arithmetic
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+class QuantizedCatalog {
+public:
+	QuantizedCatalog(int bits = 8) ;
+
+	void build(const std::vector<std::vector<cv::Mat> > &model_sets) ;
+	cv::Mat correlations(const std::vector<std::vector<cv::Mat> > &target_sets, const std::vector<int> &region_weights) const ;
+	cv::Mat histogram(size_t model, size_t region) const ;
+
+	size_t num_models() const { return model_count ; }
+	size_t bytes() const ;
+
+private:
+	/**
+	 * @brief The sums over the quantized bins of one histogram that its correlations need
+	 */
+	struct bin_sums {
+		int64_t sum ;
+		double spread ;	//sqrt(n * sum of squares - sum * sum)
+	} ;
+
+	template<typename T> void quantize(const cv::Mat &hist, T *bins, float &scale, bin_sums &sums) const ;
+	template<typename T> void correlate_target(const std::vector<cv::Mat> &target_set, const std::vector<int> &region_weights,
+		float *target_correlations) const ;
+
+	int bits ;
+	size_t model_count ;
+	size_t num_regions ;	//compared regions
+	int num_bins ;
+
+	std::vector<uint8_t> bins8 ;
+	std::vector<uint16_t> bins16 ;
+	std::vector<float> scales ;		//bin value of one quantization step, for each model and region
+	std::vector<bin_sums> sums ;	//for each model and region
+} ;
@@ -0,0 +1,328 @@
+/**
+ * @file jpeg_exif.cpp
+ * @brief Carry the EXIF segment of a source JPEG over to a newly encoded JPEG.
+ *
+ * The APP1 segment is read from the header of the source, so the compressed image data is never read.
+ * The few tags that no longer hold after correction are patched in place, and the segment is spliced
+ * in after the SOI marker of the encoded output, which is then written in one pass.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgcodecs.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+using namespace cv ;
+
+#include "jpeg_exif.hpp"
+
+const uchar JPEG_MARKER = 0xFF ;
+const uchar JPEG_SOI = 0xD8 ;
+const uchar JPEG_EOI = 0xD9 ;
+const uchar JPEG_SOS = 0xDA ;
+const uchar JPEG_APP0 = 0xE0 ;
+const uchar JPEG_APP1 = 0xE1 ;
+
+//marker (2), length (2), "Exif\0\0" (6)
+const size_t EXIF_TIFF_OFFSET = 10 ;
+
+const unsigned short TIFF_TYPE_SHORT = 3 ;
+const unsigned short TIFF_TYPE_LONG = 4 ;
+
+const unsigned short TAG_IMAGE_WIDTH = 0x0100 ;
+const unsigned short TAG_IMAGE_LENGTH = 0x0101 ;
+const unsigned short TAG_ORIENTATION = 0x0112 ;
+const unsigned short TAG_EXIF_IFD = 0x8769 ;
+const unsigned short TAG_PIXEL_X_DIMENSION = 0xA002 ;
+const unsigned short TAG_PIXEL_Y_DIMENSION = 0xA003 ;
+
+/**
+ * @brief The TIFF structure inside an EXIF segment, in either byte order
+ */
+struct tiff_block {
+	uchar *data ;
+	size_t size ;
+	bool is_big_endian ;
+
+	unsigned get16(size_t pos) const {
+		return is_big_endian ? (data[pos] << 8) | data[pos + 1] : data[pos] | (data[pos + 1] << 8) ;
+	}
+	unsigned get32(size_t pos) const {
+		return is_big_endian ? (get16(pos) << 16) | get16(pos + 2) : get16(pos) | (get16(pos + 2) << 16) ;
+	}
+	void put16(size_t pos, unsigned val) {
+		uchar hi = (val >> 8) & 0xFF, lo = val & 0xFF ;
+		data[pos] = is_big_endian ? hi : lo ;
+		data[pos + 1] = is_big_endian ? lo : hi ;
+	}
+	void put32(size_t pos, unsigned val) {
+		put16(pos + (is_big_endian ? 0 : 2), val >> 16) ;
+		put16(pos + (is_big_endian ? 2 : 0), val & 0xFFFF) ;
+	}
+} ;
+
+/**
+ * @brief Find an entry of an IFD
+ *
+ * @return size_t offset of the 12-byte entry within the TIFF block, or 0 if there is no such tag
+ */
+static size_t find_ifd_entry(const tiff_block &tiff, size_t ifd_offset, unsigned tag) {
+	if(ifd_offset + 2 > tiff.size) {
+		return 0 ;
+	}
+
+	const unsigned num_entries = tiff.get16(ifd_offset) ;
+
+	for(unsigned i = 0 ; i < num_entries ; i++) {
+		const size_t entry = ifd_offset + 2 + i * 12 ;
+		if(entry + 12 > tiff.size) {
+			return 0 ;
+		}
+		if(tiff.get16(entry) == tag) {
+			return entry ;
+		}
+	}
+	return 0 ;
+}
+
+/**
+ * @brief Overwrite the value of a single SHORT or LONG entry. The value is not changed if it does not fit the type.
+ *
+ * @return true if the tag was found and written
+ */
+static bool set_ifd_value(tiff_block &tiff, size_t ifd_offset, unsigned tag, unsigned val) {
+	const size_t entry = find_ifd_entry(tiff, ifd_offset, tag) ;
+
+	if(entry == 0 || tiff.get32(entry + 4) != 1) {
+		return false ;
+	}
+
+	const unsigned type = tiff.get16(entry + 2) ;
+
+	if(type == TIFF_TYPE_SHORT && val <= 0xFFFF) {
+		tiff.put16(entry + 8, val) ;
+		return true ;
+	}
+	if(type == TIFF_TYPE_LONG) {
+		tiff.put32(entry + 8, val) ;
+		return true ;
+	}
+	return false ;
+}
+
+/**
+ * @brief Locate the TIFF structure of an EXIF segment and its first IFD
+ *
+ * @return true if the segment is a valid TIFF structure
+ */
+static bool open_tiff_block(std::vector<uchar> &segment, tiff_block &tiff, size_t &ifd0) {
+	if(segment.size() < EXIF_TIFF_OFFSET + 8) {
+		return false ;
+	}
+
+	tiff.data = segment.data() + EXIF_TIFF_OFFSET ;
+	tiff.size = segment.size() - EXIF_TIFF_OFFSET ;
+
+	if(tiff.data[0] == 'M' && tiff.data[1] == 'M') {
+		tiff.is_big_endian = true ;
+	} else if(tiff.data[0] == 'I' && tiff.data[1] == 'I') {
+		tiff.is_big_endian = false ;
+	} else {
+		return false ;
+	}
+
+	ifd0 = tiff.get32(4) ;
+	return ifd0 >= 8 && ifd0 < tiff.size ;
+}
+
+/**
+ * @brief Whether a file name has a JPEG extension
+ */
+bool is_jpeg_path(const std::string &path) {
+	auto dot = path.find_last_of('.') ;
+	if(dot == std::string::npos) {
+		return false ;
+	}
+
+	std::string ext = path.substr(dot + 1) ;
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower) ;
+
+	return ext == "jpg" || ext == "jpeg" || ext == "jpe" ;
+}
+
+/**
+ * @brief Read the EXIF APP1 segment of a JPEG file. Only the markers before the image data are read.
+ *
+ * @param path JPEG file
+ * @param segment the whole segment, starting with the FF E1 marker
+ * @return true if the file has an EXIF segment
+ */
+bool read_exif_segment(const std::string &path, std::vector<uchar> &segment) {
+	std::ifstream ifs(path, std::ios::binary) ;
+	uchar buf[4] ;
+
+	if(!ifs.read((char *)buf, 2) || buf[0] != JPEG_MARKER || buf[1] != JPEG_SOI) {
+		return false ;
+	}
+
+	while(ifs.read((char *)buf, 2)) {
+		if(buf[0] != JPEG_MARKER) {
+			return false ;
+		}
+
+		uchar marker = buf[1] ;
+
+		//fill bytes
+		while(marker == JPEG_MARKER) {
+			if(!ifs.read((char *)&marker, 1)) {
+				return false ;
+			}
+		}
+
+		if(marker == JPEG_SOS || marker == JPEG_EOI) {
+			return false ;
+		}
+
+		//markers without a length field: TEM, RSTn
+		if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+			continue ;
+		}
+
+		if(!ifs.read((char *)buf + 2, 2)) {
+			return false ;
+		}
+
+		const size_t len = (buf[2] << 8) | buf[3] ;	//includes the length field
+		if(len < 2) {
+			return false ;
+		}
+
+		if(marker == JPEG_APP1 && len >= EXIF_TIFF_OFFSET - 2 + 8) {
+			segment.resize(len + 2) ;
+			segment[0] = JPEG_MARKER ;
+			segment[1] = JPEG_APP1 ;
+			segment[2] = buf[2] ;
+			segment[3] = buf[3] ;
+
+			if(!ifs.read((char *)segment.data() + 4, len - 2)) {
+				return false ;
+			}
+
+			if(memcmp(segment.data() + 4, "Exif\0\0", 6) == 0) {
+				return true ;
+			}
+			//an XMP segment, keep looking
+			continue ;
+		}
+
+		ifs.seekg(len - 2, std::ios::cur) ;
+	}
+
+	return false ;
+}
+
+/**
+ * @brief The Orientation tag of an EXIF segment
+ *
+ * @param segment as from read_exif_segment()
+ * @return unsigned 1 to 8, or 1 if the tag is absent or the segment is not valid
+ */
+unsigned read_exif_orientation(std::vector<uchar> segment) {
+	tiff_block tiff ;
+	size_t ifd0 ;
+	if(!open_tiff_block(segment, tiff, ifd0)) {
+		return 1 ;
+	}
+
+	const size_t entry = find_ifd_entry(tiff, ifd0, TAG_ORIENTATION) ;
+	if(entry == 0 || tiff.get16(entry + 2) != TIFF_TYPE_SHORT) {
+		return 1 ;
+	}
+
+	const unsigned orientation = tiff.get16(entry + 8) ;
+	return (orientation >= 1 && orientation <= 8) ? orientation : 1 ;
+}
+
+/**
+ * @brief Update an EXIF segment for the corrected image. Orientation is reset, since the pixels were already
+ * rotated when the source was read, and the image dimensions are set to those of the new image.
+ * Tags that are absent stay absent.
+ *
+ * @param segment as from read_exif_segment()
+ * @param image_size size of the image that the segment will be written with
+ * @return true if the segment is a valid TIFF structure
+ */
+bool patch_exif_segment(std::vector<uchar> &segment, Size image_size) {
+	tiff_block tiff ;
+	size_t ifd0 ;
+	if(!open_tiff_block(segment, tiff, ifd0)) {
+		return false ;
+	}
+
+	set_ifd_value(tiff, ifd0, TAG_ORIENTATION, 1) ;
+	set_ifd_value(tiff, ifd0, TAG_IMAGE_WIDTH, image_size.width) ;
+	set_ifd_value(tiff, ifd0, TAG_IMAGE_LENGTH, image_size.height) ;
+
+	const size_t exif_entry = find_ifd_entry(tiff, ifd0, TAG_EXIF_IFD) ;
+	if(exif_entry != 0) {
+		const size_t exif_ifd = tiff.get32(exif_entry + 8) ;
+		if(exif_ifd >= 8 && exif_ifd < tiff.size) {
+			set_ifd_value(tiff, exif_ifd, TAG_PIXEL_X_DIMENSION, image_size.width) ;
+			set_ifd_value(tiff, exif_ifd, TAG_PIXEL_Y_DIMENSION, image_size.height) ;
+		}
+	}
+
+	return true ;
+}
+
+/**
+ * @brief Encode an image to JPEG and write it with an EXIF segment, in one pass over the output file.
+ * The JFIF APP0 segment of the encoder output is dropped, as EXIF takes its place directly after SOI.
+ *
+ * @param path output file
+ * @param img
+ * @param segment EXIF APP1 segment, or empty to write the encoder output as it is
+ * @param params as for imwrite()
+ * @return true if the file was written
+ */
+bool write_jpeg_with_exif(const std::string &path, const Mat &img, const std::vector<uchar> &segment, const std::vector<int> &params) {
+	std::vector<uchar> encoded ;
+
+	if(!imencode(".jpg", img, encoded, params) || encoded.size() < 4) {
+		return false ;
+	}
+
+	size_t body_start = 2 ;	//after SOI
+
+	if(!segment.empty() && encoded.size() > 6 && encoded[2] == JPEG_MARKER && encoded[3] == JPEG_APP0) {
+		body_start = 4 + ((encoded[4] << 8) | encoded[5]) ;
+		if(body_start > encoded.size()) {
+			body_start = 2 ;
+		}
+	}
+
+	std::ofstream ofs(path, std::ios::binary | std::ios::trunc) ;
+	if(!ofs) {
+		return false ;
+	}
+
+	ofs.write((const char *)encoded.data(), 2) ;
+	if(!segment.empty()) {
+		ofs.write((const char *)segment.data(), segment.size()) ;
+	}
+	ofs.write((const char *)encoded.data() + body_start, encoded.size() - body_start) ;
+
+	return ofs.good() ;
+}
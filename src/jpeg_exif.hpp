@@ -0,0 +1,20 @@
+/**
+ * @file jpeg_exif.hpp
+ * @brief Carry the EXIF segment of a source JPEG over to a newly encoded JPEG,
+ * without a metadata library and without writing the output file twice.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+bool is_jpeg_path(const std::string &path) ;
+bool read_exif_segment(const std::string &path, std::vector<uchar> &segment) ;
+unsigned read_exif_orientation(std::vector<uchar> segment) ;
+bool patch_exif_segment(std::vector<uchar> &segment, cv::Size image_size) ;
+bool write_jpeg_with_exif(const std::string &path, const cv::Mat &img, const std::vector<uchar> &segment,
+	const std::vector<int> &params = std::vector<int>()) ;
@@ -0,0 +1,561 @@
+/**
+ * @file jpeg_roi.cpp
+ * @brief Decode only the regions of a JPEG that cover a set of rects.
+ *
+ * With libjpeg-turbo, the decoder is cropped to the columns spanning all the rects, and the rows
+ * above, between and below them are skipped. Skipped rows are still entropy-decoded, but not
+ * dequantized, inverse transformed, upsampled or color converted, which is most of the cost.
+ * Without libjpeg, or for other formats, the whole image is read and the rects are copied out.
+ *
+ * The EXIF orientation is not applied, as with imread() of the images written by fixperspective,
+ * whose orientation is always set to normal.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgcodecs.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#endif
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csetjmp>
+#include <unistd.h>
+
+#ifdef USE_LIBJPEG
+#include <jpeglib.h>
+//jpeg_crop_scanline() and jpeg_skip_scanlines() came with libjpeg-turbo 1.5
+#if !defined(LIBJPEG_TURBO_VERSION_NUMBER) || LIBJPEG_TURBO_VERSION_NUMBER < 1005000
+#undef USE_LIBJPEG
+#endif
+#endif
+
+using namespace cv ;
+
+#include "jpeg_roi.hpp"
+#include "jpeg_exif.hpp"
+
+/**
+ * @brief Parse a name made by slot_image_filename()
+ *
+ * @param filename name or path of the slot image
+ * @param name receives the parts
+ * @return true if the name has the form of a slot image name
+ */
+bool parse_slot_image_filename(const std::string &filename, slot_image_name &name) {
+	auto base = filename.substr(filename.find_last_of('/') + 1) ;
+
+	auto pos_ext = base.find_last_of('.') ;
+	if(pos_ext == std::string::npos) {
+		return false ;
+	}
+	name.ext = base.substr(pos_ext + 1) ;
+	auto stem = base.substr(0, pos_ext) ;
+
+	//the last three fields, from the end: <x>@<y>, s<slot>, r<row>
+	std::string fields[3] ;
+	for(auto &field : fields) {
+		auto pos_sep = stem.find_last_of('_') ;
+		if(pos_sep == std::string::npos) {
+			return false ;
+		}
+		field = stem.substr(pos_sep + 1) ;
+		stem = stem.substr(0, pos_sep) ;
+	}
+
+	char trailing ;
+	if(sscanf(fields[0].c_str(), "%d@%d%c", &name.origin.x, &name.origin.y, &trailing) != 2 ||
+		sscanf(fields[1].c_str(), "s%d%c", &name.slot, &trailing) != 1 ||
+		sscanf(fields[2].c_str(), "r%d%c", &name.row, &trailing) != 1) {
+		return false ;
+	}
+
+	//the prefixes written by extract_drinks are two letters, three digits and an underscore
+	name.prefix.clear() ;
+	if(stem.size() > 6 && isalpha(stem[0]) && isalpha(stem[1]) &&
+		isdigit(stem[2]) && isdigit(stem[3]) && isdigit(stem[4]) && stem[5] == '_') {
+		name.prefix = stem.substr(0, 6) ;
+		stem = stem.substr(6) ;
+	}
+	name.source_stem = stem ;
+
+	return !stem.empty() ;
+}
+
+#ifdef USE_LIBJPEG
+/**
+ * @brief libjpeg calls error_exit() on a fatal error, which by default exits the program.
+ * Jump back to the decoding function instead.
+ */
+struct jpeg_roi_error_mgr {
+	struct jpeg_error_mgr pub ;
+	jmp_buf setjmp_buffer ;
+} ;
+
+static void jpeg_roi_error_exit(j_common_ptr cinfo) {
+	char message[JMSG_LENGTH_MAX] ;
+	(*cinfo->err->format_message)(cinfo, message) ;
+	std::cerr << "JPEG decoding failed: " << message << std::endl ;
+
+	longjmp(((jpeg_roi_error_mgr *)cinfo->err)->setjmp_buffer, 1) ;
+}
+
+/**
+ * @brief Read the header and start decompressing. Errors jump back here, so no object with a destructor may live in this function.
+ *
+ * @return int 1 if started, 0 if the file could not be decoded, -1 if it is not a color space handled here
+ */
+static int jpeg_roi_start_decompress(struct jpeg_decompress_struct *cinfo, jpeg_roi_error_mgr *jerr, FILE *fp, bool is_color) {
+	if(setjmp(jerr->setjmp_buffer)) {
+		return 0 ;
+	}
+
+	jpeg_create_decompress(cinfo) ;
+	jpeg_stdio_src(cinfo, fp) ;
+	jpeg_read_header(cinfo, TRUE) ;
+
+	if(cinfo->jpeg_color_space != JCS_GRAYSCALE && cinfo->jpeg_color_space != JCS_YCbCr && cinfo->jpeg_color_space != JCS_RGB) {
+		return -1 ;
+	}
+
+	cinfo->out_color_space = is_color ? JCS_EXT_BGR : JCS_GRAYSCALE ;
+	jpeg_start_decompress(cinfo) ;
+	return 1 ;
+}
+
+/**
+ * @brief Decode the rows from y_begin to y_end that are needed, cropped to the columns from x_begin to x_end,
+ * and copy each roi out into its image. Everything is allocated by the caller, and errors jump back here,
+ * so no object with a destructor may live in this function.
+ *
+ * @param row_buffer holds a full output row
+ * @param is_row_needed one flag for each row from y_begin
+ * @return true if decoded
+ */
+static bool jpeg_roi_read_rows(struct jpeg_decompress_struct *cinfo, jpeg_roi_error_mgr *jerr,
+	int x_begin, int x_end, int y_begin, int y_end, uchar *row_buffer, const uchar *is_row_needed,
+	const Rect *rois, size_t num_rois, Mat *images) {
+	if(setjmp(jerr->setjmp_buffer)) {
+		return false ;
+	}
+
+	const int channels = cinfo->output_components ;
+
+	//widened by libjpeg to an iMCU boundary on the left. Widened here by an iMCU on the right as well,
+	//as chroma upsampling treats the right edge of the crop as the edge of the image
+	const int x_padded_end = std::min(x_end + cinfo->max_h_samp_factor * DCTSIZE, (int)cinfo->output_width) ;
+	JDIMENSION crop_x = x_begin, crop_width = x_padded_end - x_begin ;
+	jpeg_crop_scanline(cinfo, &crop_x, &crop_width) ;
+
+	JSAMPROW row_pointer = row_buffer ;
+
+	if(y_begin > 0) {
+		jpeg_skip_scanlines(cinfo, y_begin) ;
+	}
+
+	int y = y_begin ;
+	while(y < y_end) {
+		if(!is_row_needed[y - y_begin]) {
+			int y_skip_end = y ;
+			while(y_skip_end < y_end && !is_row_needed[y_skip_end - y_begin]) {
+				y_skip_end++ ;
+			}
+			jpeg_skip_scanlines(cinfo, y_skip_end - y) ;
+			y = y_skip_end ;
+			continue ;
+		}
+
+		jpeg_read_scanlines(cinfo, &row_pointer, 1) ;
+
+		for(size_t idx = 0 ; idx < num_rois ; idx++) {
+			const Rect &roi = rois[idx] ;
+			if(y >= roi.y && y < roi.y + roi.height) {
+				const uchar *src_row = row_buffer + (roi.x - crop_x) * channels ;
+				memcpy(images[idx].ptr<uchar>(y - roi.y), src_row, roi.width * channels) ;
+			}
+		}
+		y++ ;
+	}
+
+	return true ;
+}
+
+/**
+ * @brief Decode the rows and columns of the file that cover rois, and copy each roi out
+ *
+ * @return int 1 if decoded, 0 if the file could not be decoded, -1 if it is not a color space handled here
+ */
+static int decode_jpeg_rois_libjpeg(const std::string &path, const std::vector<Rect> &rois, std::vector<Mat> &images, bool is_color) {
+	FILE *fp = fopen(path.c_str(), "rb") ;
+	if(!fp) {
+		return 0 ;
+	}
+
+	//zeroed, so that it can be destroyed whatever point the start failed at
+	struct jpeg_decompress_struct cinfo ;
+	memset(&cinfo, 0, sizeof(cinfo)) ;
+	jpeg_roi_error_mgr jerr ;
+
+	cinfo.err = jpeg_std_error(&jerr.pub) ;
+	jerr.pub.error_exit = jpeg_roi_error_exit ;
+
+	const int rc_start = jpeg_roi_start_decompress(&cinfo, &jerr, fp, is_color) ;
+	if(rc_start != 1) {
+		jpeg_destroy_decompress(&cinfo) ;
+		fclose(fp) ;
+		return rc_start ;
+	}
+
+	const int channels = cinfo.output_components ;
+	const Rect rc_image(0, 0, cinfo.output_width, cinfo.output_height) ;
+
+	//the span of all the rects, in columns and rows
+	int x_begin = rc_image.width, x_end = 0 ;
+	int y_begin = rc_image.height, y_end = 0 ;
+
+	images.clear() ;
+	std::vector<Rect> rois_clipped ;
+	for(auto roi : rois) {
+		roi &= rc_image ;
+		rois_clipped.push_back(roi) ;
+		images.push_back(roi.area() > 0 ? Mat(roi.size(), CV_8UC(channels)) : Mat()) ;
+
+		if(roi.area() > 0) {
+			x_begin = std::min(x_begin, roi.x) ;
+			x_end = std::max(x_end, roi.x + roi.width) ;
+			y_begin = std::min(y_begin, roi.y) ;
+			y_end = std::max(y_end, roi.y + roi.height) ;
+		}
+	}
+
+	bool is_decoded = true ;
+	if(x_end > x_begin) {
+		//the widened crop is never wider than the image
+		std::vector<uchar> row_buffer(rc_image.width * channels) ;
+
+		std::vector<uchar> is_row_needed(y_end - y_begin, 0) ;
+		for(const auto &roi : rois_clipped) {
+			for(int y = roi.y ; y < roi.y + roi.height ; y++) {
+				is_row_needed[y - y_begin] = 1 ;
+			}
+		}
+
+		is_decoded = jpeg_roi_read_rows(&cinfo, &jerr, x_begin, x_end, y_begin, y_end, row_buffer.data(), is_row_needed.data(),
+			rois_clipped.data(), rois_clipped.size(), images.data()) ;
+	}
+
+	//the rows below the rects are never decoded
+	jpeg_abort_decompress(&cinfo) ;
+	jpeg_destroy_decompress(&cinfo) ;
+	fclose(fp) ;
+
+	if(!is_decoded) {
+		images.clear() ;
+		return 0 ;
+	}
+	return 1 ;
+}
+#endif
+
+/**
+ * @brief Decode the parts of an image covered by rois, without decoding the rest if it is a JPEG
+ *
+ * @param path image file
+ * @param rois rects in the image. Parts outside the image are clipped off.
+ * @param images receives one image per rect, BGR or grayscale. Empty for a rect entirely outside the image.
+ * @param is_color decode as BGR, or as grayscale
+ * @return true if the file could be decoded
+ */
+bool decode_jpeg_rois(const std::string &path, const std::vector<Rect> &rois, std::vector<Mat> &images, bool is_color) {
+#ifdef USE_LIBJPEG
+	if(is_jpeg_path(path)) {
+		int rc = decode_jpeg_rois_libjpeg(path, rois, images, is_color) ;
+		if(rc >= 0) {
+			return rc > 0 ;
+		}
+	}
+#endif
+
+	Mat src = imread(path, is_color ? IMREAD_COLOR : IMREAD_GRAYSCALE) ;
+	if(src.empty()) {
+		return false ;
+	}
+
+	const Rect rc_image(Point(0, 0), src.size()) ;
+	images.clear() ;
+	for(const auto &roi : rois) {
+		const Rect roi_clipped = roi & rc_image ;
+		images.push_back(roi_clipped.area() > 0 ? src(roi_clipped).clone() : Mat()) ;
+	}
+	return true ;
+}
+
+Mat decode_jpeg_roi(const std::string &path, Rect roi, bool is_color) {
+	std::vector<Mat> images ;
+	if(!decode_jpeg_rois(path, std::vector<Rect>(1, roi), images, is_color)) {
+		return Mat() ;
+	}
+	return images.at(0) ;
+}
+
+/**
+ * @brief Get the size of an image, from the header alone if it is a JPEG
+ */
+bool read_image_size(const std::string &path, Size &size) {
+#ifdef USE_LIBJPEG
+	if(is_jpeg_path(path)) {
+		FILE *fp = fopen(path.c_str(), "rb") ;
+		if(!fp) {
+			return false ;
+		}
+
+		struct jpeg_decompress_struct cinfo ;
+		jpeg_roi_error_mgr jerr ;
+		cinfo.err = jpeg_std_error(&jerr.pub) ;
+		jerr.pub.error_exit = jpeg_roi_error_exit ;
+
+		if(setjmp(jerr.setjmp_buffer)) {
+			jpeg_destroy_decompress(&cinfo) ;
+			fclose(fp) ;
+			return false ;
+		}
+
+		jpeg_create_decompress(&cinfo) ;
+		jpeg_stdio_src(&cinfo, fp) ;
+		jpeg_read_header(&cinfo, TRUE) ;
+		size = Size(cinfo.image_width, cinfo.image_height) ;
+		jpeg_destroy_decompress(&cinfo) ;
+		fclose(fp) ;
+		return true ;
+	}
+#endif
+
+	Mat img = imread(path, IMREAD_UNCHANGED) ;
+	size = img.size() ;
+	return !img.empty() ;
+}
+
+/**
+ * @brief Cut a slot image again from the image extract_drinks cut it from, decoding only the slot.
+ * The rect is the origin in the slot image name and the size of the slot image.
+ * This holds for slot images extracted without -H. With -H, the origin is in the corrected frame,
+ * not in the original photo.
+ *
+ * @param slot_path slot image written by extract_drinks
+ * @param source_dir directory holding the source image
+ * @param is_color decode as BGR, or as grayscale
+ * @return Mat the slot, or an empty Mat if the name is not a slot image name or a file cannot be read
+ */
+Mat recrop_slot_image(const std::string &slot_path, const std::string &source_dir, bool is_color) {
+	slot_image_name name ;
+	if(!parse_slot_image_filename(slot_path, name)) {
+		std::cerr << "Not a slot image name: " << slot_path << std::endl ;
+		return Mat() ;
+	}
+
+	Size slot_size ;
+	if(!read_image_size(slot_path, slot_size)) {
+		std::cerr << "Could not read the size of " << slot_path << std::endl ;
+		return Mat() ;
+	}
+
+	const auto source_path = source_dir + "/" + name.source_filename() ;
+	Mat slot = decode_jpeg_roi(source_path, Rect(name.origin, slot_size), is_color) ;
+	if(slot.empty()) {
+		std::cerr << "Could not decode the slot from " << source_path << std::endl ;
+	}
+	return slot ;
+}
+
+/**
+ * @brief Whether the slots of an image decoded with imread() can be cut losslessly from its file.
+ * It must be a JPEG that imread() did not rotate, so that the rects in the decoded image are rects in the file.
+ *
+ * @param path image file
+ * @param decoded_size size of the image as decoded by imread()
+ */
+bool can_crop_jpeg_losslessly(const std::string &path, Size decoded_size) {
+#ifdef USE_LIBJPEG
+	Size size ;
+	if(!is_jpeg_path(path) || !read_image_size(path, size) || size != decoded_size) {
+		return false ;
+	}
+
+	std::vector<uchar> segment ;
+	return !read_exif_segment(path, segment) || read_exif_orientation(segment) == 1 ;
+#else
+	return false ;
+#endif
+}
+
+/**
+ * @brief Cut rects out of a JPEG file into JPEG files, by copying the DCT coefficients of the blocks that cover them,
+ * as jpegtran -crop does. Nothing is decoded or encoded, so the crops are bit-exact and much faster to make.
+ * A crop can only start on an MCU boundary, so the origin of each rect is moved up and left to the boundary,
+ * by up to 15 pixels, and the rect is enlarged to keep its bottom right corner.
+ *
+ * @param src_path JPEG file
+ * @param rects rects in the image
+ * @param dest_path_for returns the file to write for the rect at an index, given the rect that is actually cut
+ * @param crop_rects receives the rects that are cut. Empty for a rect entirely outside the image, which is not written.
+ * @return true if all the crops were written. If any was not, those already written are deleted, so that none are left behind.
+ */
+bool write_jpeg_lossless_crops(const std::string &src_path, const std::vector<Rect> &rects,
+	std::function<std::string(size_t, Rect)> dest_path_for, std::vector<Rect> &crop_rects) {
+#ifdef USE_LIBJPEG
+	//no object with a destructor may be created between a setjmp() and the longjmp() back to it,
+	//so the rects and file names are worked out between reading the source and writing the crops
+	std::vector<std::string> dest_paths ;
+
+	FILE *fp = fopen(src_path.c_str(), "rb") ;
+	if(!fp) {
+		return false ;
+	}
+
+	struct jpeg_decompress_struct srcinfo ;
+	struct jpeg_compress_struct dstinfo ;
+	jpeg_roi_error_mgr jerr ;
+	FILE * volatile fp_out = NULL ;
+	volatile bool is_dst_created = false ;
+	volatile size_t num_written = 0 ;
+
+	srcinfo.err = jpeg_std_error(&jerr.pub) ;
+	dstinfo.err = &jerr.pub ;
+	jerr.pub.error_exit = jpeg_roi_error_exit ;
+
+	if(setjmp(jerr.setjmp_buffer)) {
+		jpeg_destroy_decompress(&srcinfo) ;
+		fclose(fp) ;
+		return false ;
+	}
+
+	jpeg_create_decompress(&srcinfo) ;
+	jpeg_stdio_src(&srcinfo, fp) ;
+	jpeg_read_header(&srcinfo, TRUE) ;
+	jvirt_barray_ptr *src_coef_arrays = jpeg_read_coefficients(&srcinfo) ;
+
+	const int mcu_width = srcinfo.max_h_samp_factor * DCTSIZE ;
+	const int mcu_height = srcinfo.max_v_samp_factor * DCTSIZE ;
+	const Rect rc_image(0, 0, srcinfo.image_width, srcinfo.image_height) ;
+
+	crop_rects.clear() ;
+	for(size_t idx = 0 ; idx < rects.size() ; idx++) {
+		const Rect rc = rects[idx] & rc_image ;
+		if(rc.area() == 0) {
+			crop_rects.push_back(Rect()) ;
+			dest_paths.push_back("") ;
+			continue ;
+		}
+
+		const int x_crop = rc.x / mcu_width * mcu_width ;
+		const int y_crop = rc.y / mcu_height * mcu_height ;
+		const Rect rc_crop(x_crop, y_crop, rc.x + rc.width - x_crop, rc.y + rc.height - y_crop) ;
+		crop_rects.push_back(rc_crop) ;
+		dest_paths.push_back(dest_path_for(idx, rc_crop)) ;
+	}
+
+	if(setjmp(jerr.setjmp_buffer)) {
+		if(is_dst_created) {
+			jpeg_destroy_compress(&dstinfo) ;
+		}
+		if(fp_out) {
+			fclose(fp_out) ;
+		}
+		jpeg_destroy_decompress(&srcinfo) ;
+		fclose(fp) ;
+
+		//the crop being written, and those before it
+		for(size_t idx = 0 ; idx <= num_written && idx < dest_paths.size() ; idx++) {
+			if(!dest_paths[idx].empty()) {
+				unlink(dest_paths[idx].c_str()) ;
+			}
+		}
+		return false ;
+	}
+
+	for( ; num_written < crop_rects.size() ; num_written++) {
+		const Rect rc_crop = crop_rects[num_written] ;
+		if(rc_crop.area() == 0) {
+			continue ;
+		}
+
+		const char *dest_path = dest_paths[num_written].c_str() ;
+		fp_out = fopen(dest_path, "wb") ;
+		if(!fp_out) {
+			std::cerr << "Could not write " << dest_path << std::endl ;
+			break ;
+		}
+
+		jpeg_create_compress(&dstinfo) ;
+		is_dst_created = true ;
+		jpeg_copy_critical_parameters(&srcinfo, &dstinfo) ;
+		dstinfo.image_width = rc_crop.width ;
+		dstinfo.image_height = rc_crop.height ;
+		dstinfo.optimize_coding = TRUE ;
+
+		const JDIMENSION width_in_mcus = (rc_crop.width + mcu_width - 1) / mcu_width ;
+		const JDIMENSION height_in_mcus = (rc_crop.height + mcu_height - 1) / mcu_height ;
+
+		jvirt_barray_ptr dst_coef_arrays[MAX_COMPONENTS] ;
+		for(int ci = 0 ; ci < dstinfo.num_components ; ci++) {
+			const jpeg_component_info *comp = dstinfo.comp_info + ci ;
+			dst_coef_arrays[ci] = (*dstinfo.mem->request_virt_barray)((j_common_ptr)&dstinfo, JPOOL_IMAGE, FALSE,
+				width_in_mcus * comp->h_samp_factor, height_in_mcus * comp->v_samp_factor, comp->v_samp_factor) ;
+		}
+
+		jpeg_stdio_dest(&dstinfo, fp_out) ;
+		jpeg_write_coefficients(&dstinfo, dst_coef_arrays) ;
+
+		//the blocks of each component, from the block at the crop origin
+		for(int ci = 0 ; ci < dstinfo.num_components ; ci++) {
+			const jpeg_component_info *comp = dstinfo.comp_info + ci ;
+			const JDIMENSION x_offset_blocks = rc_crop.x / mcu_width * comp->h_samp_factor ;
+			const JDIMENSION y_offset_blocks = rc_crop.y / mcu_height * comp->v_samp_factor ;
+			const JDIMENSION width_in_blocks = width_in_mcus * comp->h_samp_factor ;
+			const JDIMENSION height_in_blocks = height_in_mcus * comp->v_samp_factor ;
+
+			for(JDIMENSION blk_y = 0 ; blk_y < height_in_blocks ; blk_y += comp->v_samp_factor) {
+				JBLOCKARRAY dst_buffer = (*dstinfo.mem->access_virt_barray)((j_common_ptr)&dstinfo, dst_coef_arrays[ci],
+					blk_y, comp->v_samp_factor, TRUE) ;
+				JBLOCKARRAY src_buffer = (*srcinfo.mem->access_virt_barray)((j_common_ptr)&srcinfo, src_coef_arrays[ci],
+					blk_y + y_offset_blocks, comp->v_samp_factor, FALSE) ;
+
+				for(int offset_y = 0 ; offset_y < comp->v_samp_factor ; offset_y++) {
+					memcpy(dst_buffer[offset_y], src_buffer[offset_y] + x_offset_blocks, width_in_blocks * sizeof(JBLOCK)) ;
+				}
+			}
+		}
+
+		jpeg_finish_compress(&dstinfo) ;
+		jpeg_destroy_compress(&dstinfo) ;
+		is_dst_created = false ;
+		fclose(fp_out) ;
+		fp_out = NULL ;
+	}
+
+	jpeg_finish_decompress(&srcinfo) ;
+	jpeg_destroy_decompress(&srcinfo) ;
+	fclose(fp) ;
+
+	if(num_written < crop_rects.size()) {
+		for(size_t idx = 0 ; idx < num_written ; idx++) {
+			if(!dest_paths[idx].empty()) {
+				unlink(dest_paths[idx].c_str()) ;
+			}
+		}
+		return false ;
+	}
+	return true ;
+#else
+	return false ;
+#endif
+}
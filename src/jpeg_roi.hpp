@@ -0,0 +1,40 @@
+/**
+ * @file jpeg_roi.hpp
+ * @brief Decode only the regions of a JPEG that cover a set of rects, crop a JPEG without decoding it,
+ * and recover the rect of a slot image from the name given to it by slot_image_filename().
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+/**
+ * @brief The parts of a slot image name <prefix><source stem>_r<row>_s<slot>_<x>@<y>.<ext>
+ */
+struct slot_image_name {
+	std::string prefix ;		//"dr000_", "pr000_" or empty
+	std::string source_stem ;	//name of the image the slot was cut from, without extension
+	std::string ext ;
+	int row ;
+	int slot ;
+	cv::Point origin ;			//top left of the slot in the source image
+
+	std::string source_filename() const { return source_stem + "." + ext ; }
+} ;
+
+bool parse_slot_image_filename(const std::string &filename, slot_image_name &name) ;
+
+bool read_image_size(const std::string &path, cv::Size &size) ;
+bool decode_jpeg_rois(const std::string &path, const std::vector<cv::Rect> &rois, std::vector<cv::Mat> &images,
+	bool is_color = true) ;
+cv::Mat decode_jpeg_roi(const std::string &path, cv::Rect roi, bool is_color = true) ;
+cv::Mat recrop_slot_image(const std::string &slot_path, const std::string &source_dir, bool is_color = true) ;
+
+bool can_crop_jpeg_losslessly(const std::string &path, cv::Size decoded_size) ;
+bool write_jpeg_lossless_crops(const std::string &src_path, const std::vector<cv::Rect> &rects,
+	std::function<std::string(size_t, cv::Rect)> dest_path_for, std::vector<cv::Rect> &crop_rects) ;
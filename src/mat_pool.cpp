@@ -0,0 +1,180 @@
+/**
+ * @file mat_pool.cpp
+ * @brief A cv::MatAllocator that keeps freed image buffers for reuse.
+ *
+ * The allocation follows OpenCV's own StdMatAllocator, except that large buffers are taken from
+ * and returned to free lists keyed by their size. After the first photo of a batch, the HSV images,
+ * planes, edge and mask images of the next photo of the same size are served from the lists.
+ * One pool, guarded by a mutex, serves all threads.
+ *
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#endif
+
+#include <algorithm>
+
+using namespace cv ;
+
+#include "mat_pool.hpp"
+
+static PooledMatAllocator *installed_pool = NULL ;
+
+static inline size_t pooled_size(size_t bytes) {
+	return (bytes + MAT_POOL_GRANULARITY - 1) / MAT_POOL_GRANULARITY * MAT_POOL_GRANULARITY ;
+}
+
+PooledMatAllocator::PooledMatAllocator(size_t max_cached_bytes) : max_cached_bytes(max_cached_bytes) {}
+
+PooledMatAllocator::~PooledMatAllocator() {
+	release_cached() ;
+}
+
+UMatData* PooledMatAllocator::allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+	mat_pool_access_flag /*flags*/, UMatUsageFlags /*usageFlags*/) const {
+	size_t total = CV_ELEM_SIZE(type) ;
+
+	for(int i = dims - 1 ; i >= 0 ; i--) {
+		if(step) {
+			if(data0 && step[i] != CV_AUTOSTEP) {
+				CV_Assert(total <= step[i]) ;
+				total = step[i] ;
+			} else {
+				step[i] = total ;
+			}
+		}
+		total *= sizes[i] ;
+	}
+
+	uchar *data = data0 ? (uchar *)data0 : take(total) ;
+
+	UMatData *u = new UMatData(this) ;
+	u->data = u->origdata = data ;
+	u->size = total ;
+	if(data0) {
+		u->flags |= UMatData::USER_ALLOCATED ;
+	}
+	return u ;
+}
+
+bool PooledMatAllocator::allocate(UMatData* u, mat_pool_access_flag /*accessflags*/, UMatUsageFlags /*usageFlags*/) const {
+	return u != NULL ;
+}
+
+void PooledMatAllocator::deallocate(UMatData* u) const {
+	if(!u) {
+		return ;
+	}
+
+	CV_Assert(u->urefcount == 0) ;
+	CV_Assert(u->refcount == 0) ;
+
+	if(!(u->flags & UMatData::USER_ALLOCATED)) {
+		give_back(u->origdata, u->size) ;
+		u->origdata = 0 ;
+	}
+	delete u ;
+}
+
+/**
+ * @brief Get a buffer of at least bytes, from a free list if there is one of the same rounded size
+ */
+uchar *PooledMatAllocator::take(size_t bytes) const {
+	if(bytes < MAT_POOL_MIN_BYTES) {
+		return (uchar *)fastMalloc(bytes) ;
+	}
+
+	const size_t rounded = pooled_size(bytes) ;
+	{
+		std::lock_guard<std::mutex> lock(mtx) ;
+		auto it = free_lists.find(rounded) ;
+		if(it != free_lists.end() && !it->second.empty()) {
+			uchar *data = it->second.back() ;
+			it->second.pop_back() ;
+			counters.cached_bytes -= rounded ;
+			counters.hits++ ;
+			return data ;
+		}
+		counters.misses++ ;
+	}
+
+	return (uchar *)fastMalloc(rounded) ;
+}
+
+/**
+ * @brief Return a buffer to its free list, or to the heap if the pool is full
+ */
+void PooledMatAllocator::give_back(uchar *data, size_t bytes) const {
+	if(bytes < MAT_POOL_MIN_BYTES) {
+		fastFree(data) ;
+		return ;
+	}
+
+	const size_t rounded = pooled_size(bytes) ;
+	{
+		std::lock_guard<std::mutex> lock(mtx) ;
+		if(counters.cached_bytes + rounded <= max_cached_bytes) {
+			free_lists[rounded].push_back(data) ;
+			counters.cached_bytes += rounded ;
+			counters.peak_cached_bytes = std::max(counters.peak_cached_bytes, counters.cached_bytes) ;
+			return ;
+		}
+	}
+
+	fastFree(data) ;
+}
+
+/**
+ * @brief Free all buffers held in the free lists, for example before a batch of photos of another size
+ */
+void PooledMatAllocator::release_cached() {
+	std::lock_guard<std::mutex> lock(mtx) ;
+
+	for(auto &fl : free_lists) {
+		for(auto data : fl.second) {
+			fastFree(data) ;
+		}
+	}
+	free_lists.clear() ;
+	counters.cached_bytes = 0 ;
+}
+
+mat_pool_stats PooledMatAllocator::stats() const {
+	std::lock_guard<std::mutex> lock(mtx) ;
+	return counters ;
+}
+
+void PooledMatAllocator::print_stats(std::ostream &os) const {
+	auto st = stats() ;
+
+	os << "Mat pool: " << st.hits << " reused, " << st.misses << " allocated, "
+		<< st.cached_bytes / 1024 << " KiB cached (peak " << st.peak_cached_bytes / 1024 << " KiB)" << std::endl ;
+}
+
+/**
+ * @brief Make the pool the allocator of all Mats created from now on. Mats that already exist
+ * are still released through the allocator that created them.
+ * The pool is never destroyed, since Mats in static storage may be released after main() returns.
+ *
+ * @return PooledMatAllocator* the installed pool
+ */
+PooledMatAllocator *install_mat_pool() {
+	if(!installed_pool) {
+		installed_pool = new PooledMatAllocator() ;
+		Mat::setDefaultAllocator(installed_pool) ;
+	}
+	return installed_pool ;
+}
+
+/**
+ * @brief The pool set by install_mat_pool(), or NULL
+ */
+PooledMatAllocator *mat_pool() {
+	return installed_pool ;
+}
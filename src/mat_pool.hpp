@@ -0,0 +1,62 @@
+/**
+ * @file mat_pool.hpp
+ * @brief A cv::MatAllocator that keeps freed image buffers for reuse, so that processing a batch of
+ * same-sized photos does not go back to the heap for every temporary.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <iostream>
+
+//buffers smaller than this are not pooled
+const size_t MAT_POOL_MIN_BYTES = 64 * 1024 ;
+//pooled sizes are rounded up to this, so that slightly different sizes share a free list
+const size_t MAT_POOL_GRANULARITY = 4096 ;
+//default limit on the memory held in free lists
+const size_t MAT_POOL_MAX_CACHED_BYTES = 512 * 1024 * 1024 ;
+
+#if CV_VERSION_MAJOR >= 4
+typedef cv::AccessFlag mat_pool_access_flag ;
+#else
+typedef int mat_pool_access_flag ;
+#endif
+
+struct mat_pool_stats {
+	size_t hits = 0 ;	//pooled allocations served from a free list
+	size_t misses = 0 ;	//pooled allocations that went to the heap
+	size_t cached_bytes = 0 ;	//memory currently in free lists
+	size_t peak_cached_bytes = 0 ;
+} ;
+
+class PooledMatAllocator : public cv::MatAllocator {
+public:
+	PooledMatAllocator(size_t max_cached_bytes = MAT_POOL_MAX_CACHED_BYTES) ;
+	~PooledMatAllocator() ;
+
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+		mat_pool_access_flag flags, cv::UMatUsageFlags usageFlags) const ;
+	bool allocate(cv::UMatData* u, mat_pool_access_flag accessflags, cv::UMatUsageFlags usageFlags) const ;
+	void deallocate(cv::UMatData* u) const ;
+
+	void release_cached() ;
+	mat_pool_stats stats() const ;
+	void print_stats(std::ostream &os) const ;
+
+private:
+	uchar *take(size_t bytes) const ;
+	void give_back(uchar *data, size_t bytes) const ;
+
+	size_t max_cached_bytes ;
+	mutable std::mutex mtx ;
+	mutable std::map<size_t, std::vector<uchar*> > free_lists ;	//keyed by rounded size
+	mutable mat_pool_stats counters ;
+} ;
+
+PooledMatAllocator *install_mat_pool() ;
+PooledMatAllocator *mat_pool() ;
@@ -17,14 +17,30 @@ Trim and image of a soft drink container to remove the background margin.
 #include <unistd.h>
 #include <libgen.h>
 #include <fstream>
+#include <getopt.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <sstream>
 
 #include "lines.hpp"
 #include "trim_rect.hpp"
+#include "mat_pool.hpp"
+#include "jpeg_roi.hpp"
 
 using namespace cv;
 
 int process_file(std::string filename);
+void run_file(const std::string &filename);
+void queue_input(const std::string &path, std::function<void(const std::string &)> handle_file);
+void write_rect_record(const std::string &filename, Rect rc_clip, bool is_valid);
+void benchmark_trim(Mat src_gray, float threshold_ratio);
 void write_processed_file(Mat img, std::string filepath);
+std::ostream &diagnostics();
 #ifdef USE_GUI
 int show_result_images(Mat target, Mat corners, Rect rc_clip, bool isValid = true);
 #endif
@@ -32,18 +48,79 @@ int show_result_images(Mat target, Mat corners, Rect rc_clip, bool isValid = tru
 auto cmdopt_verbose = false;
 auto cmdopt_batch = false;
 auto cmdopt_equalizehist = false ;
+auto cmdopt_benchmark = false ;
+auto cmdoptval_jobs = 1 ;
+auto cmdoptval_rects_format = std::string("") ;  //empty to write trimmed images, or csv / json
+auto cmdoptval_source_dir = std::string("") ;  //cut the slots again from the images in this directory
 auto thresh = 127;
 
 auto dest_dir = std::string(".") ;
 
+//the rect records of all workers go to stdout through this
+std::mutex rects_output_mutex ;
+auto is_first_rect_record = true ;
+
+/*
+Input paths, pushed by the main thread as it reads the arguments, directories or stdin,
+and taken by the worker threads. Bounded, so that a long list is streamed rather than read up front.
+*/
+class path_queue
+{
+public:
+    path_queue(size_t capacity) : m_capacity(capacity), m_is_closed(false) {}
+
+    void push(const std::string &path)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this] { return m_paths.size() < m_capacity; });
+        m_paths.push_back(path);
+        m_not_empty.notify_one();
+    }
+
+    //false when the queue is closed and empty
+    bool pop(std::string &path)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return m_is_closed || !m_paths.empty(); });
+        if (m_paths.empty())
+        {
+            return false;
+        }
+        path = m_paths.front();
+        m_paths.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_is_closed = true;
+        m_not_empty.notify_all();
+    }
+
+private:
+    std::deque<std::string> m_paths;
+    size_t m_capacity;
+    bool m_is_closed;
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty, m_not_full;
+};
+
 void help()
 {
-    std::cout << "trim_drink" << std::endl ;
+    std::cout << "trim_drink [options] file|dir ..." << std::endl ;
+    std::cout << "trim_drink [options] -    (read file paths from stdin, one per line)" << std::endl ;
     std::cout << "  -b : batch mode (no display)" << std::endl ;
+    std::cout << "  -B : time the fast trimming against the full corner image, and check that they agree" << std::endl ;
     std::cout << "  -d dir : batch mode target directory" << std::endl ;
     std::cout << "  -e : equalize histogram" << std::endl ;
     std::cout << "  -h : help" << std::endl ;
+    std::cout << "  -j num : process files with num worker threads (implies -b)" << std::endl ;
+    std::cout << "  -S dir : cut each input slot image again from the image in dir that extract_drinks cut it from," << std::endl ;
+    std::cout << "           decoding only the slot. The inputs must be named as extract_drinks names them, and not extracted with -H" << std::endl ;
     std::cout << "  -v : verbose" << std::endl ;
+    std::cout << "  --rects-only[=csv|json] : print the trim rect of each file to stdout instead of writing trimmed images" << std::endl ;
 
     exit(0) ;
 }
@@ -52,20 +129,44 @@ int main(int argc, char **argv)
 {
     if (argc < 2) { help(); }
 
+    //reuse the buffers of the temporary images from one file to the next
+    install_mat_pool();
+
     int c;
     char *cvalue;
+    bool is_dest_dir_set = false;
+
+    const int LONGOPT_RECTS_ONLY = 256 ;
 
-    while ((c = getopt(argc, argv, "bd:ehv")) != -1)
+    static struct option long_options[] = {
+        {"rects-only", optional_argument, 0, LONGOPT_RECTS_ONLY },
+        {0,            0,                 0,  0 }
+    };
+
+    while ((c = getopt_long(argc, argv, "bBd:ehj:S:v", long_options, NULL)) != -1)
     {
         switch (c)
         {
+        case LONGOPT_RECTS_ONLY:
+            cmdoptval_rects_format = optarg ? optarg : "csv";
+            if (cmdoptval_rects_format != "csv" && cmdoptval_rects_format != "json")
+            {
+                std::cerr << "Unknown rects format: " << cmdoptval_rects_format << std::endl;
+                help();
+            }
+            cmdopt_batch = true;
+            break;
         case 'b':
             cmdopt_batch = true;
             break;
+        case 'B':
+            cmdopt_benchmark = true;
+            cmdopt_batch = true;
+            break;
         case 'd':
             cvalue = optarg;
             dest_dir = cvalue;
-            std::cout << "Dest dir:" << dest_dir << std::endl;
+            is_dest_dir_set = true;
             break;
         case 'e':
             cmdopt_equalizehist = true;
@@ -74,66 +175,253 @@ int main(int argc, char **argv)
             help();
             exit(0);
             break;
+        case 'j':
+            cmdoptval_jobs = atoi(optarg);
+            if (cmdoptval_jobs < 1)
+            {
+                std::cerr << "Number of jobs must be at least 1" << std::endl;
+                exit(-1);
+            }
+            break;
+        case 'S':
+            cmdoptval_source_dir = optarg;
+            break;
         case 'v':
             cmdopt_verbose = true;
             break;
         }
     }
 
-    for (auto idx = optind; idx < argc; idx++) {
-        char *filename = argv[idx];
+    //after all the options, once it is known where diagnostics go
+    if (is_dest_dir_set)
+    {
+        diagnostics() << "Dest dir:" << dest_dir << std::endl;
+    }
+
+    if (cmdoptval_rects_format == "csv")
+    {
+        std::cout << "file,x,y,width,height,valid" << std::endl;
+    }
+    else if (cmdoptval_rects_format == "json")
+    {
+        std::cout << "[" << std::endl;
+    }
+
+    //with one job, files are processed on the main thread as they are listed
+    path_queue queue(cmdoptval_jobs * 4);
+    std::vector<std::thread> workers;
+    std::function<void(const std::string &)> handle_file = run_file;
+
+    if (cmdoptval_jobs > 1)
+    {
+        //there is nothing to display from the workers
+        cmdopt_batch = true;
+        //parallelism is across files; each worker runs OpenCV functions serially
+        setNumThreads(1);
 
-        std::ifstream ifile(filename);
-        if (!ifile)
+        for (int i = 0; i < cmdoptval_jobs; i++)
         {
-            std::cerr << "File does not exist: " << filename << std::endl;
+            workers.push_back(std::thread([&queue]() {
+                std::string filename;
+                while (queue.pop(filename))
+                {
+                    run_file(filename);
+                }
+            }));
         }
+        handle_file = [&queue](const std::string &filename) { queue.push(filename); };
+    }
 
-        if (cmdopt_verbose)
+    if (argc - optind == 1 && std::string(argv[optind]) == "-")
+    {
+        std::string line;
+        while (std::getline(std::cin, line))
         {
-            std::cout << "Start processing " << filename << std::endl;
+            if (!line.empty())
+            {
+                queue_input(line, handle_file);
+            }
+        }
+    }
+    else
+    {
+        for (auto idx = optind; idx < argc; idx++) {
+            queue_input(argv[idx], handle_file);
         }
+    }
 
-        process_file(filename);
+    queue.close();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    if (cmdoptval_rects_format == "json")
+    {
+        std::cout << std::endl << "]" << std::endl;
+    }
+
+    if (cmdopt_verbose)
+    {
+        mat_pool()->print_stats(diagnostics());
+    }
+
+    return 0;
+}
+
+/*
+Pass a file to handle_file, or each regular file in it if it is a directory
+*/
+void queue_input(const std::string &path, std::function<void(const std::string &)> handle_file)
+{
+    struct stat path_stat;
+
+    if (stat(path.c_str(), &path_stat) != 0)
+    {
+        std::cerr << "File does not exist: " << path << std::endl;
+        return;
+    }
+
+    if (!S_ISDIR(path_stat.st_mode))
+    {
+        handle_file(path);
+        return;
+    }
+
+    DIR *pdir = opendir(path.c_str());
+    if (!pdir)
+    {
+        std::cerr << "Could not open directory: " << path << std::endl;
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(pdir)))
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
 
-        if (cmdopt_verbose)
+        std::string entry_path = path + "/" + entry->d_name;
+        if (stat(entry_path.c_str(), &path_stat) == 0 && S_ISREG(path_stat.st_mode))
         {
-            std::cout << "Finished processing " << filename << std::endl;
+            handle_file(entry_path);
         }
+    }
+    closedir(pdir);
+}
+
+/*
+Where messages other than the output go: stderr when the rects are printed to stdout,
+so that they are not mixed into the records
+*/
+std::ostream &diagnostics()
+{
+    return cmdoptval_rects_format.empty() ? std::cout : std::cerr;
+}
 
+void run_file(const std::string &filename)
+{
+    if (cmdopt_verbose)
+    {
+        diagnostics() << "Start processing " + filename + "\n" << std::flush;
     }
 
-    return 0;
+    process_file(filename);
+
+    if (cmdopt_verbose)
+    {
+        diagnostics() << "Finished processing " + filename + "\n" << std::flush;
+    }
 }
 
 int process_file(std::string infilepath)
 {
+    const bool is_rects_only = !cmdoptval_rects_format.empty();
+
+    //for the rect alone, the decoder can skip the color conversion
     Mat src, src_gray ;
-    src = imread(infilepath, 1);
-    cvtColor(src, src_gray, COLOR_BGR2GRAY);
+    if (!cmdoptval_source_dir.empty())
+    {
+        src = recrop_slot_image(infilepath, cmdoptval_source_dir, !is_rects_only);
+        if (is_rects_only)
+        {
+            src_gray = src;
+        }
+        else if (!src.empty())
+        {
+            cvtColor(src, src_gray, COLOR_BGR2GRAY);
+        }
+    }
+    else if (is_rects_only)
+    {
+        src_gray = imread(infilepath, IMREAD_GRAYSCALE);
+    }
+    else
+    {
+        src = imread(infilepath, 1);
+        if (!src.empty())
+        {
+            cvtColor(src, src_gray, COLOR_BGR2GRAY);
+        }
+    }
+
+    if (src_gray.empty())
+    {
+        std::cerr << "File is not a valid image: " << infilepath << std::endl;
+        return -1;
+    }
 
     // img_corners = Mat::zeros( src.size(), CV_32FC1 );
 
     float threshold_ratio = 0.01;
     std::vector<size_t> marked_rows ;
-    Mat detected_corners = src_gray.clone();
+    Mat detected_corners ;
+
+    if (cmdopt_benchmark)
+    {
+        benchmark_trim(src_gray, threshold_ratio);
+    }
+
+    //the corner image is only needed to show the corners
+    #ifdef USE_GUI
+    const bool is_show_corners = !cmdopt_batch;
+    #else
+    const bool is_show_corners = false;
+    #endif
 
-    Rect rc_clip = get_trim_rect(src_gray, detected_corners, threshold_ratio, cmdopt_equalizehist);
+    Rect rc_clip;
+    if (is_show_corners)
+    {
+        detected_corners = src_gray.clone();
+        rc_clip = get_trim_rect(src_gray, detected_corners, threshold_ratio, cmdopt_equalizehist);
+    }
+    else
+    {
+        rc_clip = get_trim_rect_fast(src_gray, threshold_ratio);
+    }
 
     //end of processing
 
 
     bool is_valid_rect = true;
     //TODO: Further checks to see if it is valid
-    if (rc_clip.height < src.cols) {
+    if (rc_clip.height < src_gray.cols) {
         is_valid_rect = false;
     }
 
+    if (is_rects_only)
+    {
+        write_rect_record(infilepath, rc_clip, is_valid_rect);
+        return is_valid_rect ? 0 : -1;
+    }
+
     #ifdef USE_GUI
     if (!cmdopt_batch) {
         int show_key = show_result_images(src_gray, detected_corners, rc_clip, is_valid_rect);
         if (cmdopt_verbose) {
-            std::cout << "Window closed with keycode: " << show_key << std::endl;
+            diagnostics() << "Window closed with keycode: " << show_key << std::endl;
         }
     }
     #endif
@@ -143,7 +431,7 @@ int process_file(std::string infilepath)
        write_processed_file(src(rc_clip), infilepath);
     } else {
         if (cmdopt_verbose) {
-            std::cout << "Invalid trim rectangle." << std::endl;
+            diagnostics() << "Invalid trim rectangle." << std::endl;
             return -1 ;
         }
     }
@@ -151,6 +439,38 @@ int process_file(std::string infilepath)
     return 0;
 }
 
+/*
+Print the trim rect of a file as a CSV row or a JSON array element, in the order the workers finish
+*/
+void write_rect_record(const std::string &filename, Rect rc_clip, bool is_valid)
+{
+    std::lock_guard<std::mutex> lock(rects_output_mutex);
+
+    std::string escaped;
+    for (auto ch : filename)
+    {
+        if (ch == '"' || (ch == '\\' && cmdoptval_rects_format == "json"))
+        {
+            escaped += (cmdoptval_rects_format == "json") ? '\\' : '"';
+        }
+        escaped += ch;
+    }
+
+    if (cmdoptval_rects_format == "json")
+    {
+        std::cout << (is_first_rect_record ? "" : ",\n")
+            << "  {\"file\": \"" << escaped << "\", \"x\": " << rc_clip.x << ", \"y\": " << rc_clip.y
+            << ", \"width\": " << rc_clip.width << ", \"height\": " << rc_clip.height
+            << ", \"valid\": " << (is_valid ? "true" : "false") << "}";
+    }
+    else
+    {
+        std::cout << "\"" << escaped << "\"," << rc_clip.x << "," << rc_clip.y << ","
+            << rc_clip.width << "," << rc_clip.height << "," << (is_valid ? 1 : 0) << std::endl;
+    }
+    is_first_rect_record = false;
+}
+
 
 #ifdef USE_GUI
 /*
@@ -191,6 +511,45 @@ int show_result_images(Mat img_target, Mat img_corners, Rect rc_clip, bool is_va
 }
 #endif
 
+/*
+Time get_trim_rect() and get_trim_rect_fast() on the same image, and report whether they agree.
+*/
+void benchmark_trim(Mat src_gray, float threshold_ratio)
+{
+    const int repeats = 20;
+
+    Rect rc_full, rc_fast;
+    Mat detected_corners;
+
+    auto t0 = getTickCount();
+    for (int i = 0; i < repeats; i++)
+    {
+        detected_corners = src_gray.clone();
+        rc_full = get_trim_rect(src_gray, detected_corners, threshold_ratio);
+    }
+    auto t1 = getTickCount();
+    for (int i = 0; i < repeats; i++)
+    {
+        rc_fast = get_trim_rect_fast(src_gray, threshold_ratio);
+    }
+    auto t2 = getTickCount();
+
+    const double msec_full = (t1 - t0) * 1000.0 / getTickFrequency() / repeats;
+    const double msec_fast = (t2 - t1) * 1000.0 / getTickFrequency() / repeats;
+
+    //one line, written at once, so that the lines of workers do not mix
+    std::stringstream line;
+    line << "Trim " << src_gray.cols << "x" << src_gray.rows
+        << ": corner image " << msec_full << " ms, fast " << msec_fast << " ms, "
+        << (rc_full == rc_fast ? "same rect" : "DIFFERENT rect") << " " << rc_fast;
+    if (rc_full != rc_fast)
+    {
+        line << " vs " << rc_full;
+    }
+    line << "\n";
+    diagnostics() << line.str() << std::flush;
+}
+
 void write_processed_file(Mat img, std::string infilepath)
 {
     //Write out the drink images to files
@@ -202,7 +561,7 @@ void write_processed_file(Mat img, std::string infilepath)
 
     if (cmdopt_verbose)
     {
-        std::cout << "Writing trimmed image to " << outfilepath.str() << std::endl;
+        diagnostics() << "Writing trimmed image to " << outfilepath.str() << std::endl;
     }
     imwrite(outfilepath.str(), img);
 }
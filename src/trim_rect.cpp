@@ -11,12 +11,289 @@
 using namespace cv ;
 
 #include <iostream>
+#include <algorithm>
+#include <cfloat>
 #include "trim_rect.hpp"
 
 extern bool cmdopt_verbose ;
 
 int max_vertical_aggregation(Mat img) ;
 
+//free parameter of the Harris detector, as passed to cornerHarris()
+const float TRIM_HARRIS_K = 0.04f ;
+//rows per band when computing the row maxima in parallel
+const int TRIM_BAND_ROWS = 32 ;
+
+/**
+ * Trim off the background above the container: the largest gap between consecutive rows that contain corners.
+ * marked_rows: indices of the rows with corners, in increasing order
+ * size: size of the slot image
+ */
+static Rect background_trim_rect(const std::vector<size_t> &marked_rows, Size size)
+{
+    //find the greatest gap between consecutive marked rows,
+    //this should be the background area at the top of the slot
+
+    int top_edge = 0;
+    int bottom_edge = 0;
+    int prev = 0;
+
+    for (auto y : marked_rows) {
+        if(y > (size_t)((size.height * 3) / 2)) {
+            break ;
+        }
+        int span = y - prev;
+        if (span > bottom_edge - top_edge)
+        {
+            top_edge = prev;
+            bottom_edge = y;
+        }
+        prev = y;
+    }
+
+    //check if the detected value is reasonable for an extracted slot image
+    //if not, reject it and set it back to the top
+    if ((size.height - bottom_edge) < size.width * 1.3) {
+        bottom_edge = 0 ;
+    }
+
+    return Rect(0, bottom_edge, size.width, size.height - bottom_edge);
+}
+
+static inline int reflect101(int i, int len)
+{
+    return i < 0 ? -i : (i >= len ? 2 * len - i - 2 : i) ;
+}
+
+/**
+ * Load a row of the image as float, with one reflected pixel at each end, as BORDER_REFLECT_101
+ */
+static void load_padded_row(const Mat &src_gray, int y, float *pad)
+{
+    const int cols = src_gray.cols ;
+    const uchar *p = src_gray.ptr<uchar>(reflect101(y, src_gray.rows)) ;
+
+    for (int x = 0; x < cols; x++) {
+        pad[x + 1] = p[x] ;
+    }
+    pad[0] = p[1] ;
+    pad[cols + 1] = p[cols - 2] ;
+}
+
+/**
+ * The products of the 3x3 Sobel derivatives for one row, each summed with its left neighbour,
+ * which is the horizontal half of the 2x2 block of cornerHarris()
+ */
+static void harris_row_sums(const float *pad_above, const float *pad, const float *pad_below, int cols,
+    float *dxx, float *dxy, float *dyy, float *sxx, float *sxy, float *syy)
+{
+    //dxx etc. hold the products at column x - 1, which is padded index x
+    for (int c = 1; c <= cols; c++) {
+        const float dx = (pad_above[c + 1] - pad_above[c - 1]) + 2 * (pad[c + 1] - pad[c - 1]) + (pad_below[c + 1] - pad_below[c - 1]) ;
+        const float dy = (pad_below[c - 1] + 2 * pad_below[c] + pad_below[c + 1]) - (pad_above[c - 1] + 2 * pad_above[c] + pad_above[c + 1]) ;
+        dxx[c] = dx * dx ;
+        dxy[c] = dx * dy ;
+        dyy[c] = dy * dy ;
+    }
+
+    //the block sums reflect the products, so column -1 takes those of column 1
+    dxx[0] = dxx[2] ;
+    dxy[0] = dxy[2] ;
+    dyy[0] = dyy[2] ;
+
+    for (int x = 0; x < cols; x++) {
+        sxx[x] = dxx[x] + dxx[x + 1] ;
+        sxy[x] = dxy[x] + dxy[x + 1] ;
+        syy[x] = dyy[x] + dyy[x + 1] ;
+    }
+}
+
+/**
+ * The maximum Harris response of each row, as cornerHarris(src_gray, dst, 2, 3, 0.04) up to a constant factor,
+ * computed a row at a time without the response image. Bands of rows are done in parallel.
+ * col_ranges: column ranges, each of which gets its own maximum
+ * row_max: receives rows x col_ranges.size() values, the ranges of a row being consecutive
+ */
+static void harris_row_max(const Mat &src_gray, const std::vector<Range> &col_ranges, std::vector<float> &row_max)
+{
+    const int rows = src_gray.rows ;
+    const int cols = src_gray.cols ;
+    const int num_bands = (rows + TRIM_BAND_ROWS - 1) / TRIM_BAND_ROWS ;
+    const size_t num_ranges = col_ranges.size() ;
+
+    row_max.assign(rows * num_ranges, 0) ;
+
+    parallel_for_(Range(0, num_bands), [&](const Range &range) {
+        std::vector<float> buf((cols + 2) * 3 + (cols + 1) * 3 + cols * 6) ;
+        float *pads[3] = { &buf[0], &buf[cols + 2], &buf[(cols + 2) * 2] } ;
+        float *dxx = &buf[(cols + 2) * 3] ;
+        float *dxy = dxx + cols + 1 ;
+        float *dyy = dxy + cols + 1 ;
+        float *sxx_prev = dyy + cols + 1 ;
+        float *sxy_prev = sxx_prev + cols ;
+        float *syy_prev = sxy_prev + cols ;
+        float *sxx = syy_prev + cols ;
+        float *sxy = sxx + cols ;
+        float *syy = sxy + cols ;
+
+        for (int band = range.start; band < range.end; band++) {
+            const int y0 = band * TRIM_BAND_ROWS ;
+            const int y1 = std::min(rows, y0 + TRIM_BAND_ROWS) ;
+
+            //the block sum of row y takes in row y - 1, reflected at the top
+            const int y_prev = reflect101(y0 - 1, rows) ;
+            load_padded_row(src_gray, y_prev - 1, pads[0]) ;
+            load_padded_row(src_gray, y_prev, pads[1]) ;
+            load_padded_row(src_gray, y_prev + 1, pads[2]) ;
+            harris_row_sums(pads[0], pads[1], pads[2], cols, dxx, dxy, dyy, sxx_prev, sxy_prev, syy_prev) ;
+
+            load_padded_row(src_gray, y0 - 1, pads[0]) ;
+            load_padded_row(src_gray, y0, pads[1]) ;
+
+            for (int y = y0; y < y1; y++) {
+                load_padded_row(src_gray, y + 1, pads[2]) ;
+                harris_row_sums(pads[0], pads[1], pads[2], cols, dxx, dxy, dyy, sxx, sxy, syy) ;
+
+                for (size_t k = 0; k < num_ranges; k++) {
+                    float rmax = -FLT_MAX ;
+                    for (int x = col_ranges[k].start; x < col_ranges[k].end; x++) {
+                        const float a = sxx[x] + sxx_prev[x] ;
+                        const float b = sxy[x] + sxy_prev[x] ;
+                        const float c = syy[x] + syy_prev[x] ;
+                        const float r = a * c - b * b - TRIM_HARRIS_K * (a + c) * (a + c) ;
+                        rmax = std::max(rmax, r) ;
+                    }
+                    row_max[y * num_ranges + k] = rmax ;
+                }
+
+                std::swap(sxx, sxx_prev) ;
+                std::swap(sxy, sxy_prev) ;
+                std::swap(syy, syy_prev) ;
+
+                float *pad_top = pads[0] ;
+                pads[0] = pads[1] ;
+                pads[1] = pads[2] ;
+                pads[2] = pad_top ;
+            }
+        }
+    }) ;
+}
+
+/**
+ * Same trimming of the background as get_trim_rect(), without the side trimming it leaves disabled.
+ * Instead of thresholding a full Harris response image and scanning it, only the maximum response
+ * of each row is kept, which is all the background trimming looks at.
+ * The responses are summed in a different order from cornerHarris(), so a row maximum near the threshold
+ * can fall on the other side of it. trim_drink -B compares the two rects on any set of inputs.
+ */
+Rect get_trim_rect_fast(Mat src_gray, float threshold_ratio)
+{
+    if (src_gray.rows < 2 || src_gray.cols < 2) {
+        return Rect(Point(0, 0), src_gray.size()) ;
+    }
+
+    std::vector<float> row_max ;
+    harris_row_max(src_gray, std::vector<Range>(1, Range(0, src_gray.cols)), row_max) ;
+
+    const float corner_threshold_val = *std::max_element(row_max.begin(), row_max.end()) * threshold_ratio ;
+
+    std::vector<size_t> marked_rows ;
+    for (size_t y = 0; y < row_max.size(); y++) {
+        if (row_max[y] > corner_threshold_val) {
+            marked_rows.push_back(y) ;
+        }
+    }
+
+    return background_trim_rect(marked_rows, src_gray.size()) ;
+}
+
+/**
+ * Trim a row of slots in one pass. The corner response is computed once over the strip that spans the slots,
+ * and one threshold, from the strongest corner in any of the slots, is applied to all of them,
+ * since slots in a row share their lighting.
+ * src_gray: the image that contains the slots
+ * rects: slot rects in src_gray, normally one row
+ * Returns the trimmed rects in src_gray coordinates, in the same order. Rects too small to trim are returned unchanged.
+ */
+std::vector<Rect> get_trim_rects(const Mat &src_gray, const std::vector<Rect> &rects, float threshold_ratio)
+{
+    std::vector<Rect> trimmed_rects(rects) ;
+    std::vector<size_t> slot_idxs ;
+    Rect rc_strip ;
+
+    for (size_t i = 0; i < rects.size(); i++) {
+        if (rects[i].width < 2 || rects[i].height < 2) {
+            continue ;
+        }
+        rc_strip = slot_idxs.empty() ? rects[i] : (rc_strip | rects[i]) ;
+        slot_idxs.push_back(i) ;
+    }
+
+    if (slot_idxs.empty()) {
+        return trimmed_rects ;
+    }
+
+    std::vector<Range> col_ranges ;
+    for (auto i : slot_idxs) {
+        col_ranges.push_back(Range(rects[i].x - rc_strip.x, rects[i].br().x - rc_strip.x)) ;
+    }
+
+    std::vector<float> row_max ;
+    harris_row_max(src_gray(rc_strip), col_ranges, row_max) ;
+
+    const size_t num_ranges = col_ranges.size() ;
+    float max_val = -FLT_MAX ;
+
+    for (size_t k = 0; k < num_ranges; k++) {
+        const Rect &rc = rects[slot_idxs[k]] ;
+        for (int y = rc.y - rc_strip.y; y < rc.br().y - rc_strip.y; y++) {
+            max_val = std::max(max_val, row_max[y * num_ranges + k]) ;
+        }
+    }
+
+    const float corner_threshold_val = max_val * threshold_ratio ;
+
+    for (size_t k = 0; k < num_ranges; k++) {
+        const Rect &rc = rects[slot_idxs[k]] ;
+        const int y_offset = rc.y - rc_strip.y ;
+
+        std::vector<size_t> marked_rows ;
+        for (int y = 0; y < rc.height; y++) {
+            if (row_max[(y + y_offset) * num_ranges + k] > corner_threshold_val) {
+                marked_rows.push_back(y) ;
+            }
+        }
+
+        trimmed_rects[slot_idxs[k]] = background_trim_rect(marked_rows, rc.size()) + rc.tl() ;
+    }
+
+    return trimmed_rects ;
+}
+
+/**
+ * get_trim_rects() for each row of slots.
+ * is_parallel: trim the rows in parallel. The bands within a row are then trimmed serially.
+ */
+std::vector<std::vector<Rect> > get_trim_rect_rows(const Mat &src_gray, const std::vector<std::vector<Rect> > &rect_rows,
+    float threshold_ratio, bool is_parallel)
+{
+    std::vector<std::vector<Rect> > trimmed_rows(rect_rows.size()) ;
+
+    auto trim_rows = [&](const Range &range) {
+        for (int r = range.start; r < range.end; r++) {
+            trimmed_rows[r] = get_trim_rects(src_gray, rect_rows[r], threshold_ratio) ;
+        }
+    } ;
+
+    if (is_parallel) {
+        parallel_for_(Range(0, (int)rect_rows.size()), trim_rows) ;
+    } else {
+        trim_rows(Range(0, (int)rect_rows.size())) ;
+    }
+
+    return trimmed_rows ;
+}
+
 /**
  * Trim a rectangle using two methods:
  * 1) Remove flat background. Detect corners and trim off everything above the highest detected corner point
@@ -77,33 +354,7 @@ Rect get_trim_rect(Mat src_gray, Mat &detected_corners, float threshold_ratio, b
         }
     }
 
-    //find the greatest gap between consecutive marked rows,
-    //this should be the background area at the top of the slot
-
-    int top_edge = 0;
-    int bottom_edge = 0;
-    int prev = 0;
-
-    for (auto y : marked_rows) {
-        if(y > (size_t)((src_gray.rows * 3) / 2)) {
-            break ;
-        }
-        int span = y - prev;
-        if (span > bottom_edge - top_edge)
-        {
-            top_edge = prev;
-            bottom_edge = y;
-        }
-        prev = y;
-    }
-
-    //check if the detected value is reasonable for an extracted slot image
-    //if not, reject it and set it back to the top
-    if ((src_gray.rows - bottom_edge) < src_gray.cols * 1.3) {
-        bottom_edge = 0 ;
-    }
-
-    Rect rc_clip = Rect(0, bottom_edge, src_gray.cols, src_gray.rows - bottom_edge);
+    Rect rc_clip = background_trim_rect(marked_rows, src_gray.size()) ;
 
     // std::cout << rc_clip << std::endl ;
     
@@ -8,3 +8,17 @@ marked_rows: Vector of rows in the image which contain detected corners. Passed
 threshold_ratio: Ratio of the maximum corner detection value to generate threshold
 */
 cv::Rect get_trim_rect(cv::Mat src_gray, cv::Mat &detected_features, float threshold_ratio = 0.01, bool isEqualize=false) ;
+
+/*
+Trims the background from the top of an image as get_trim_rect() does, from the maximum corner response of each row,
+without computing the full corner image.
+*/
+cv::Rect get_trim_rect_fast(cv::Mat src_gray, float threshold_ratio = 0.01) ;
+
+/*
+Trims a row of slots at once, computing the corners over the strip that spans them and sharing one threshold.
+rects: slot rects in src_gray. Returns the trimmed rects in src_gray coordinates.
+*/
+std::vector<cv::Rect> get_trim_rects(const cv::Mat &src_gray, const std::vector<cv::Rect> &rects, float threshold_ratio = 0.01) ;
+std::vector<std::vector<cv::Rect> > get_trim_rect_rows(const cv::Mat &src_gray, const std::vector<std::vector<cv::Rect> > &rect_rows,
+    float threshold_ratio = 0.01, bool is_parallel = true) ;
@@ -0,0 +1,183 @@
+/**
+ * @file warp_roi.cpp
+ * @brief Perspective correction of only part of an image, given the homography that fixperspective found,
+ * and the sidecar files that carry it.
+ * @version 0.1
+ * @date 2026-10-19
+ * 
+ */
+
+#if CV_VERSION_MAJOR >= 4
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgproc.hpp>
+#else
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#endif
+
+#include <iostream>
+
+using namespace cv ;
+
+#include "warp_roi.hpp"
+
+/**
+ * @brief Write the perspective data of one image. The format is chosen by the extension of path, .yml / .yaml or .json
+ * 
+ * @param sidecar 
+ * @param path 
+ * @return true if the file could be written
+ */
+bool write_perspective_sidecar(const perspective_sidecar &sidecar, const std::string &path) {
+	FileStorage fs(path, FileStorage::WRITE) ;
+
+	if(!fs.isOpened()) {
+		std::cerr << "Could not open sidecar file for writing: " << path << std::endl ;
+		return false ;
+	}
+
+	fs << "source_image" << sidecar.source_image_path ;
+	fs << "source_size" << sidecar.source_size ;
+	fs << "homography" << sidecar.homography ;
+	fs << "src_quad" << sidecar.src_quad ;
+	fs << "dst_rect" << sidecar.dst_rect ;
+	fs << "corrected_size" << sidecar.corrected_size ;
+	fs << "clip_rect" << sidecar.clip_rect ;
+	fs << "is_clipped" << (int)sidecar.is_clipped ;
+
+	return true ;
+}
+
+/**
+ * @brief Read a sidecar written by write_perspective_sidecar()
+ * 
+ * @param path 
+ * @param sidecar output
+ * @return true if the file held a usable homography
+ */
+bool read_perspective_sidecar(const std::string &path, perspective_sidecar &sidecar) {
+	FileStorage fs(path, FileStorage::READ) ;
+
+	if(!fs.isOpened()) {
+		std::cerr << "Could not open sidecar file: " << path << std::endl ;
+		return false ;
+	}
+
+	int is_clipped = 0 ;
+
+	fs["source_image"] >> sidecar.source_image_path ;
+	fs["source_size"] >> sidecar.source_size ;
+	fs["homography"] >> sidecar.homography ;
+	fs["src_quad"] >> sidecar.src_quad ;
+	fs["dst_rect"] >> sidecar.dst_rect ;
+	fs["corrected_size"] >> sidecar.corrected_size ;
+	fs["clip_rect"] >> sidecar.clip_rect ;
+	fs["is_clipped"] >> is_clipped ;
+	sidecar.is_clipped = is_clipped ;
+
+	if(sidecar.homography.rows != 3 || sidecar.homography.cols != 3) {
+		std::cerr << "No homography in sidecar file: " << path << std::endl ;
+		return false ;
+	}
+
+	return true ;
+}
+
+/**
+ * @brief Warp just one rectangle of the corrected image. The result is the same as
+ * warpPerspective() over the whole image followed by cropping to roi, 
+ * but only the pixels inside roi are computed.
+ * 
+ * @param src the original, uncorrected image
+ * @param hom homography from src to the corrected image, as from a sidecar
+ * @param roi rectangle in corrected image coordinates
+ * @param dst output, roi.size()
+ * @param interpolation 
+ * @param fill color for areas outside src, the same magenta fixperspective uses by default
+ */
+void warp_roi(const Mat &src, const Mat &hom, Rect roi, Mat &dst, int interpolation, Scalar fill) {
+	//shift the corrected image so that the roi starts at the origin
+	Mat shift = Mat::eye(3, 3, CV_64F) ;
+	shift.at<double>(0, 2) = -roi.x ;
+	shift.at<double>(1, 2) = -roi.y ;
+
+	Mat hom64 ;
+	hom.convertTo(hom64, CV_64F) ;
+
+	Mat hom_roi = shift * hom64 ;
+
+	warpPerspective(src, dst, hom_roi, roi.size(), interpolation, BORDER_CONSTANT, fill) ;
+}
+
+/**
+ * @brief Build the remap() maps for one rectangle of the corrected image. 
+ * Each map entry is the point in the source image that the corrected pixel comes from,
+ * calculated from the inverse homography one row at a time.
+ * 
+ * @param hom homography from the source to the corrected image
+ * @param roi rectangle in corrected image coordinates
+ * @param map1 output, fixed-point coordinates (CV_16SC2) as from convertMaps()
+ * @param map2 output, interpolation table indices (CV_16UC1)
+ */
+void warp_roi_maps(const Mat &hom, Rect roi, Mat &map1, Mat &map2) {
+	Mat hom_inv ;
+	invert(hom, hom_inv) ;
+	hom_inv.convertTo(hom_inv, CV_64F) ;
+
+	const double *h = hom_inv.ptr<double>(0) ;
+
+	Mat map_x(roi.size(), CV_32FC1), map_y(roi.size(), CV_32FC1) ;
+
+	for(int y = 0 ; y < roi.height ; y++) {
+		const double dy = y + roi.y ;
+		float *mx = map_x.ptr<float>(y) ;
+		float *my = map_y.ptr<float>(y) ;
+
+		//along a row, each of the three terms changes by a constant step
+		double sx = h[0] * roi.x + h[1] * dy + h[2] ;
+		double sy = h[3] * roi.x + h[4] * dy + h[5] ;
+		double sw = h[6] * roi.x + h[7] * dy + h[8] ;
+
+		for(int x = 0 ; x < roi.width ; x++) {
+			const double w = (sw != 0) ? 1.0 / sw : 0 ;
+			mx[x] = (float)(sx * w) ;
+			my[x] = (float)(sy * w) ;
+
+			sx += h[0] ;
+			sy += h[3] ;
+			sw += h[6] ;
+		}
+	}
+
+	convertMaps(map_x, map_y, map1, map2, CV_16SC2) ;
+}
+
+/**
+ * @brief Warp several rectangles of the corrected image from the original image, in parallel.
+ * Only the area of the rectangles is computed, so extracting a few small slot images from a large photo
+ * costs much less than warping the whole photo and cropping.
+ * 
+ * @param src the original, uncorrected image
+ * @param hom homography from src to the corrected image
+ * @param rois rectangles in corrected image coordinates
+ * @param dsts output, one image for each rectangle
+ * @param interpolation INTER_NEAREST, INTER_LINEAR or INTER_CUBIC
+ * @param fill color for areas outside src
+ */
+void warp_rois(const Mat &src, const Mat &hom, const std::vector<Rect> &rois, std::vector<Mat> &dsts, 
+	int interpolation, Scalar fill) {
+	dsts.assign(rois.size(), Mat()) ;
+
+	parallel_for_(Range(0, (int)rois.size()), [&](const Range &range) {
+		for(int i = range.start ; i < range.end ; i++) {
+			if(rois[i].area() <= 0) {
+				continue ;
+			}
+
+			Mat map1, map2 ;
+			warp_roi_maps(hom, rois[i], map1, map2) ;
+
+			remap(src, dsts[i], map1, map2, interpolation, BORDER_CONSTANT, fill) ;
+		}
+	}) ;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file warp_roi.hpp
+ * @brief Perspective correction of only part of an image, given the homography that fixperspective found,
+ * and the sidecar files that carry it.
+ * @version 0.1
+ * @date 2026-10-19
+ * 
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Everything needed to correct the perspective of a source image later, without detecting it again.
+ * Coordinates of dst_rect and clip_rect are in the full corrected image.
+ */
+struct perspective_sidecar {
+	std::string source_image_path ;
+	cv::Size source_size ;
+	cv::Mat homography ;	//3x3, CV_64F, source to corrected
+	std::vector<cv::Point2f> src_quad ;	//TL, TR, BR, BL in the source
+	cv::Rect2f dst_rect ;	//where src_quad maps to
+	cv::Size corrected_size ;
+	cv::Rect clip_rect ;	//part of the corrected image with no filled background
+	bool is_clipped = false ;	//whether the written image would have been clipped to clip_rect
+
+	//the rectangle of the full corrected image that fixperspective writes out
+	inline cv::Rect output_rect() const {
+		return is_clipped ? clip_rect : cv::Rect(cv::Point(0, 0), corrected_size) ;
+	}
+} ;
+
+bool write_perspective_sidecar(const perspective_sidecar &sidecar, const std::string &path) ;
+bool read_perspective_sidecar(const std::string &path, perspective_sidecar &sidecar) ;
+
+void warp_roi(const cv::Mat &src, const cv::Mat &hom, cv::Rect roi, cv::Mat &dst, 
+	int interpolation = cv::INTER_LINEAR, cv::Scalar fill = cv::Scalar(255, 0, 255)) ;
+void warp_roi_maps(const cv::Mat &hom, cv::Rect roi, cv::Mat &map1, cv::Mat &map2) ;
+void warp_rois(const cv::Mat &src, const cv::Mat &hom, const std::vector<cv::Rect> &rois, std::vector<cv::Mat> &dsts,
+	int interpolation = cv::INTER_LINEAR, cv::Scalar fill = cv::Scalar(255, 0, 255)) ;